@@ -3,19 +3,31 @@
 //
 
 #include <cstdlib>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <fstream>
+#include <cmath>
 #include <functional>
 #include <algorithm>
 #include <cassert>
+#include <stdexcept>
+#include <utility>
+#include <memory>
 #include "big_integer.h"
-
-#define TWO_IN_32 4294967296ULL
+#include "utils/mapped_file.h"
+#include "utils/scratch_arena.h"
+#include "utils/mpn.h"
+#include "utils/mpn_small.h"
 
 //=================================================
 //==============functions=for=help=================
 //=================declaration=====================
 //=================================================
 
-int vector_compare(const smart_vector &a, const smart_vector &b);
+int magnitude_compare(big_integer_view a, big_integer_view b);
+
+int compare(big_integer_view a, big_integer_view b);
 
 void vector_shift_right(smart_vector &resource, size_t offset);
 
@@ -23,6 +35,17 @@ void vector_shift_left(smart_vector &resource, size_t offset);
 
 uint32_t search_dividend(const big_integer &a, const big_integer &divider);
 
+void vector_mul_add_short(smart_vector &resource, uint32_t multiplier, uint32_t addend);
+
+
+uint32_t find_d(uint32_t a);
+
+bool is_small(size_t n);
+
+uint32_t const *padded(big_integer_view v, size_t n, uint32_t *buf);
+
+uint32_t chunk_power(int base, size_t &digits);
+
 //=================================================
 //=============units=for=help======================
 //=================================================
@@ -32,45 +55,41 @@ union fast_split_ull {
     uint32_t u[2];
 };
 
-uint32_t carry;
-
-uint32_t safe_plus(uint64_t a, uint64_t b = 0) {
-    fast_split_ull helper;
-    helper.ull = a + b + carry;
-    carry = helper.u[1];
-    return helper.u[0];
-}
-
-uint32_t safe_minus(uint64_t a, uint64_t b) {
-    fast_split_ull helper;
-    helper.ull = TWO_IN_32 + a - b - carry;
-    if (helper.ull >= TWO_IN_32) {
-        helper.ull -= TWO_IN_32;
-        carry = 0;
-    } else {
-        carry = 1;
+// collects digits into limb-sized chunks so the number is multiplied once per chunk, not per digit
+struct digit_accumulator {
+    smart_vector result;
+    int base;
+    size_t chunk_digits;
+    uint32_t chunk_base;
+    uint32_t chunk = 0;
+    uint32_t power = 1;
+
+    explicit digit_accumulator(int base) : base(base), chunk_base(chunk_power(base, chunk_digits)) {}
+
+    void push(int digit) {
+        chunk = chunk * base + digit;
+        power *= base;
+        if (power == chunk_base) {
+            vector_mul_add_short(result, chunk_base, chunk);
+            chunk = 0;
+            power = 1;
+        }
     }
-    return helper.u[0];
-}
 
-uint32_t safe_multiplies(uint64_t a, uint64_t b, uint64_t d) {
-    fast_split_ull helper;
-    helper.ull = a * b + carry + d;
-    carry = helper.u[1];
-    return helper.u[0];
-}
+    smart_vector &finish() {
+        if (power != 1) {
+            vector_mul_add_short(result, power, chunk);
+            chunk = 0;
+            power = 1;
+        }
+        return result;
+    }
+};
 
 const auto bit_and = std::bit_and<uint32_t>();
 const auto bit_or = std::bit_or<uint32_t>();
 const auto bit_xor = std::bit_xor<uint32_t>();
 
-uint32_t bit_shl(uint64_t v, uint32_t offset) {
-    fast_split_ull helper;
-    helper.ull = (v << offset) + carry;
-    carry = helper.u[1];
-    return helper.u[0];
-}
-
 //=================================================
 //==================constructors===================
 //=================================================
@@ -85,29 +104,52 @@ big_integer::big_integer(uint32_t a) : data(1) {
     sift_zeros();
 }
 
+big_integer::big_integer(big_integer_view v) : data(v.size, no_init), is_negate(v.negative) {
+    if (v.size != 0) {
+        std::memcpy(data.data(), v.limbs, sizeof(uint32_t) * v.size);
+    }
+    sift_zeros();
+}
+
 big_integer::big_integer(std::string const &str) : data() {
-    if (str.empty()) {
+    const char *last = str.data() + str.size();
+    std::from_chars_result result = from_chars(str.data(), last, *this);
+    if (result.ec != std::errc() || result.ptr != last) {
         throw std::runtime_error("invalid string");
     }
-    size_t minus_count = 0;
-    for (char c : str) {
-        if (c == '-') {
-            ++minus_count;
-            continue;
-        } else if (c >= '0' && c <= '9') {
-            *this *= 10;
-            *this += (c - '0');
-        } else {
-            throw std::runtime_error("invalid string");
-        }
+}
+
+size_t big_integer::capacity() const {
+    return data.capacity();
+}
+
+void big_integer::reserve(size_t limbs) {
+    data.reserve(limbs);
+}
+
+void big_integer::shrink_to_fit() {
+    data.shrink_to_fit();
+}
+
+big_integer_view::big_integer_view(uint32_t const *limbs, size_t size, bool negative) :
+        limbs(limbs), size(size), negative(negative) {
+    while (this->size != 0 && limbs[this->size - 1] == 0) {
+        --this->size;
     }
-    if (str[0] == '-' && minus_count == 1) {
-        is_negate = true;
-    } else if (minus_count != 0) {
-        throw std::runtime_error("invalid string");
+    if (this->size == 0) {
+        this->negative = false;
     }
 }
 
+big_integer_view::big_integer_view(big_integer const &a) :
+        limbs(a.data.data()), size(a.data.size()), negative(a.is_negate) {}
+
+big_integer_view big_integer_view::operator-() const {
+    big_integer_view r = *this;
+    r.negative = size != 0 && !negative;
+    return r;
+}
+
 //=================================================
 //=================compare=========================
 //=================================================
@@ -136,26 +178,61 @@ bool operator>=(big_integer const &a, big_integer const &b) {
     return compare(a, b) != -1;
 }
 
+bool operator==(big_integer const &a, big_integer_view b) {
+    return compare(a, b) == 0;
+}
+
+bool operator!=(big_integer const &a, big_integer_view b) {
+    return compare(a, b) != 0;
+}
+
+bool operator<(big_integer const &a, big_integer_view b) {
+    return compare(a, b) == -1;
+}
+
+bool operator>(big_integer const &a, big_integer_view b) {
+    return compare(a, b) == 1;
+}
+
+bool operator<=(big_integer const &a, big_integer_view b) {
+    return compare(a, b) != 1;
+}
+
+bool operator>=(big_integer const &a, big_integer_view b) {
+    return compare(a, b) != -1;
+}
+
 //=================================================
 //===============unary=arithmetic==================
 //=================================================
 
+// the view of rhs must stay valid while *this is resized, so a += a works on a copy
 big_integer &big_integer::operator+=(big_integer const &rhs) {
-    if (rhs.is_zero()) {
+    if (this == &rhs) {
+        return *this += big_integer_view(big_integer(rhs));
+    }
+    return *this += big_integer_view(rhs);
+}
+
+big_integer &big_integer::operator+=(big_integer_view rhs) {
+    if (rhs.size == 0) {
         return *this;
     }
     if (is_zero()) {
-        return *this = rhs;
+        return *this = big_integer(rhs);
     }
-    if (is_negate == rhs.is_negate) {
-        carry = 0;
-        data.resize(std::max(data.size(), rhs.data.size()));
-        size_t i = 0;
-        for (; i < rhs.data.size(); ++i) {
-            data[i] = safe_plus(data[i], rhs.data[i]);
-        }
-        for (; i < data.size(); ++i) {
-            data[i] = safe_plus(data[i]);
+    if (is_negate == rhs.negative) {
+        data.resize(std::max(data.size(), rhs.size));
+        limb_span a = data.span();
+        uint32_t carry;
+        if (is_small(a.size)) {
+            uint32_t buf[mpn::small_max];
+            uint32_t const *b = padded(rhs, a.size, buf);
+            carry = mpn::small_switch(a.size, [&](auto n) {
+                return mpn::add_n<decltype(n)::value>(a.data, a.data, b);
+            });
+        } else {
+            carry = mpn::add(a.data, a.data, a.size, rhs.limbs, rhs.size);
         }
         if (carry != 0) {
             data.push_back(carry);
@@ -167,29 +244,43 @@ big_integer &big_integer::operator+=(big_integer const &rhs) {
 }
 
 big_integer &big_integer::operator-=(big_integer const &rhs) {
-    if (rhs.is_zero()) {
+    if (this == &rhs) {
+        return *this -= big_integer_view(big_integer(rhs));
+    }
+    return *this -= big_integer_view(rhs);
+}
+
+big_integer &big_integer::operator-=(big_integer_view rhs) {
+    if (rhs.size == 0) {
         return *this;
     }
     if (is_zero()) {
-        return *this = -rhs;
+        return *this = big_integer(-rhs);
     }
-    if (is_negate == rhs.is_negate) {
-        carry = 0;
-        int comp = vector_compare(data, rhs.data);
+    if (is_negate == rhs.negative) {
+        int comp = magnitude_compare(*this, rhs);
         if (comp == 0) {
             return *this = 0;
         } else if (comp == 1) {
-            for (size_t i = 0; i < data.size(); ++i) {
-                if (i < rhs.data.size()) {
-                    data[i] = safe_minus(data[i], rhs.data[i]);
-                } else {
-                    data[i] = safe_minus(data[i], 0);
-                }
+            limb_span a = data.span();
+            if (is_small(a.size)) {
+                uint32_t buf[mpn::small_max];
+                uint32_t const *b = padded(rhs, a.size, buf);
+                mpn::small_switch(a.size, [&](auto n) {
+                    return mpn::sub_n<decltype(n)::value>(a.data, a.data, b);
+                });
+            } else {
+                mpn::sub(a.data, a.data, a.size, rhs.limbs, rhs.size);
             }
         } else {
-            data.resize(rhs.data.size());
-            for (size_t i = 0; i < data.size(); ++i) {
-                data[i] = safe_minus(rhs.data[i], data[i]);
+            data.resize(rhs.size);
+            limb_span a = data.span();
+            if (is_small(a.size)) {
+                mpn::small_switch(a.size, [&](auto n) {
+                    return mpn::sub_n<decltype(n)::value>(a.data, rhs.limbs, a.data);
+                });
+            } else {
+                mpn::sub_n(a.data, rhs.limbs, a.data, a.size);
             }
             is_negate = !is_negate;
         }
@@ -202,151 +293,122 @@ big_integer &big_integer::operator-=(big_integer const &rhs) {
 }
 
 big_integer &big_integer::operator*=(big_integer const &rhs) {
-    smart_vector buf;
-    buf.resize(data.size() + rhs.data.size());
-    for (size_t i = 0; i < data.size(); i++) {
-        carry = 0;
-        for (size_t j = 0; j < rhs.data.size(); j++) {
-            buf[i + j] = safe_multiplies(data[i], rhs.data[j], buf[i + j]);
+    return *this *= big_integer_view(rhs);
+}
+
+big_integer &big_integer::operator*=(big_integer_view rhs) {
+    if (is_zero() || rhs.size == 0) {
+        return *this = 0;
+    }
+    const_limb_span a = std::as_const(data).span();
+    size_t n = std::max(a.size, rhs.size);
+    if (is_small(n) && std::min(a.size, rhs.size) >= mpn::small_min) {
+        // zero padding only adds zero limbs on top, which sift_zeros drops
+        uint32_t product[2 * mpn::small_max];
+        if (a.data == rhs.limbs && a.size == rhs.size) {
+            mpn::small_switch(n, [&](auto size) {
+                return mpn::sqr_n<decltype(size)::value>(product, a.data);
+            });
+        } else {
+            uint32_t abuf[mpn::small_max], bbuf[mpn::small_max];
+            uint32_t const *x = padded(*this, n, abuf);
+            uint32_t const *y = padded(rhs, n, bbuf);
+            mpn::small_switch(n, [&](auto size) {
+                return mpn::mul_n<decltype(size)::value>(product, x, y);
+            });
         }
-        buf[i + rhs.data.size()] = carry;
+        data.resize(a.size + rhs.size, no_init);
+        std::memcpy(data.span().data, product, sizeof(uint32_t) * data.size());
+        is_negate ^= rhs.negative;
+        sift_zeros();
+        return *this;
     }
-    is_negate ^= rhs.is_negate;
+    smart_vector buf(a.size + rhs.size, no_init);
+    if (a.data == rhs.limbs && a.size == rhs.size) {
+        mpn::sqr_basecase(buf.span().data, a.data, a.size);
+    } else {
+        mpn::mul_basecase(buf.span().data, a.data, a.size, rhs.limbs, rhs.size);
+    }
+    is_negate ^= rhs.negative;
     data.swap(buf);
     sift_zeros();
     return *this;
 }
 
+// the number of leading zero bits, 32 for 0
 uint32_t find_d(uint32_t a) {
     uint32_t mask = 2147483648;
     uint32_t r = 0;
-    while (true) {
-        if ((mask & a) != 0) {
-            return r;
-        }
+    while (mask != 0 && (mask & a) == 0) {
         ++r;
         mask >>= 1;
     }
+    return r;
 }
 
-uint32_t get(const smart_vector &v, size_t i) {
-    if (i < v.size()) {
-        return v[i];
-    } else {
-        return 0;
-    }
+big_integer &big_integer::operator/=(big_integer const &rhs) {
+    return *this /= big_integer_view(rhs);
 }
 
-uint32_t div_3_2(uint32_t u2, uint32_t u1, uint32_t u0, uint32_t d1, uint32_t d0) {
-    if (u2 == d1 && u1 == d0) {
-        return UINT32_MAX;
+big_integer &big_integer::operator/=(big_integer_view rhs) {
+    assert(rhs.size != 0);
+    if (magnitude_compare(*this, rhs) == -1) {
+        return *this = 0;
     }
-    fast_split_ull helper;
-    helper.u[0] = u1;
-    helper.u[1] = u2;
-    uint64_t U = helper.ull;
-    helper.u[0] = d0;
-    helper.u[1] = d1;
-    uint64_t D = helper.ull;
-    uint64_t Q = U / d1;
-    if (Q > UINT32_MAX) {
-        helper.u[1] = d0 - u1;
-        helper.ull -= u0;
-        if (helper.ull <= D) {
-            return UINT32_MAX;
-        } else {
-            return UINT32_MAX - 1;
-        }
+    if (rhs.size == 1) {
+        limb_span a = data.span();
+        mpn::divrem_1(a.data, a.data, a.size, rhs.limbs[0]);
+    } else if (is_small(data.size())) {
+        big_integer_view u = *this;
+        uint32_t q[mpn::small_max], r[mpn::small_max];
+        mpn::small_switch(u.size, [&](auto n) {
+            return mpn::divrem_n<decltype(n)::value>(q, r, u.limbs, rhs.limbs, rhs.size);
+        });
+        size_t qn = u.size - rhs.size + 1;
+        data.resize(qn, no_init);
+        std::memcpy(data.span().data, q, sizeof(uint32_t) * qn);
+    } else {
+        big_integer_view u = *this;
+        smart_vector q(u.size - rhs.size + 1, no_init);
+        mpn::tdiv_qr(q.data(), nullptr, u.limbs, u.size, rhs.limbs, rhs.size);
+        data.swap(q);
     }
-    uint64_t DQ = Q * d0;
-    helper.ull = U - Q * d1;
-    helper.u[1] = helper.u[0];
-    helper.u[0] = u0;
+    is_negate ^= rhs.negative;
+    sift_zeros();
+    return *this;
+}
 
-    if (helper.ull < DQ) {
-        --Q;
-        helper.ull += D;
-        if (helper.ull >= D && helper.ull < DQ) {
-            --Q;
-        }
-    }
-    helper.ull = Q;
-    return helper.u[0];
+big_integer &big_integer::operator%=(big_integer const &rhs) {
+    return *this %= big_integer_view(rhs);
 }
 
-big_integer &big_integer::operator/=(big_integer const &rhs) {
-    assert(!rhs.is_zero());
-    if (vector_compare(data, rhs.data) == -1) {
-        return *this = 0;
-    }
-    if (rhs.data.size() == 1) {
-        uint32_t d = rhs.data[0];
-        smart_vector out(data.size());
-        carry = 0;
-        fast_split_ull helper;
-        for (size_t i = data.size(); i != 0; --i) {
-            helper.u[1] = carry;
-            helper.u[0] = data[i - 1];
-            uint64_t tmp = helper.ull;
-            helper.ull /= d;
-            out[i - 1] = helper.u[0];
-            helper.ull = tmp - helper.ull * d;
-            carry = helper.u[0];
-        }
-        data.swap(out);
-        is_negate ^= rhs.is_negate;
-        sift_zeros();
+// the remainder keeps the sign of *this, like the quotient truncates toward zero
+big_integer &big_integer::operator%=(big_integer_view rhs) {
+    assert(rhs.size != 0);
+    if (magnitude_compare(*this, rhs) == -1) {
         return *this;
+    }
+    big_integer_view u = *this;
+    if (rhs.size == 1) {
+        uint32_t rest = mpn::mod_1(u.limbs, u.size, rhs.limbs[0]);
+        data.resize(1, no_init);
+        data[0] = rest;
+    } else if (is_small(u.size)) {
+        uint32_t q[mpn::small_max], r[mpn::small_max];
+        mpn::small_switch(u.size, [&](auto n) {
+            return mpn::divrem_n<decltype(n)::value>(q, r, u.limbs, rhs.limbs, rhs.size);
+        });
+        data.resize(rhs.size, no_init);
+        std::memcpy(data.span().data, r, sizeof(uint32_t) * rhs.size);
     } else {
-        bool sign = is_negate ^rhs.is_negate;
-
-        uint32_t d = find_d(rhs.data.back());
-
-        *this <<= d;
-        big_integer v = rhs << d;
-
-        is_negate = false;
-        v.is_negate = false;
-
-        size_t n = v.data.size();
-        size_t m = data.size();
-        size_t k = m - n;
-
-        smart_vector buf(k + 1);
-
-        vector_shift_right(v.data, k);
-
-        if (data.back() >= v.data.back()) {
-            buf[k] = 1;
-            *this -= v;
-        }
-
-        uint32_t d0 = v.data[v.data.size() - 2];
-        uint32_t d1 = v.data[v.data.size() - 1];
-
-
-        while (k != 0) {
-            --k;
-            v >>= 32;
-
-            size_t l = v.data.size();
-            buf[k] = div_3_2(get(data, l), get(data, l - 1), get(data, l - 2), d1, d0);
-            *this -= v * buf[k];
-            if (*this < 0) {
-                *this += v;
-                ++buf[k];
-            }
-        }
-
-        is_negate = sign;
-        data.swap(buf);
-        sift_zeros();
-        return *this;
+        scratch_frame frame;
+        uint32_t *q = frame.allocate(u.size - rhs.size + 1);
+        uint32_t *r = frame.allocate(rhs.size);
+        mpn::tdiv_qr(q, r, u.limbs, u.size, rhs.limbs, rhs.size);
+        data.resize(rhs.size, no_init);
+        std::memcpy(data.data(), r, sizeof(uint32_t) * rhs.size);
     }
-}
-
-big_integer &big_integer::operator%=(big_integer const &rhs) {
-    *this -= (*this / rhs) * rhs;
+    sift_zeros();
     return *this;
 }
 
@@ -369,31 +431,44 @@ big_integer &big_integer::operator^=(big_integer const &rhs) {
     return *this;
 }
 
+big_integer &big_integer::operator&=(big_integer_view rhs) {
+    bit_op(rhs, bit_and);
+    return *this;
+}
+
+big_integer &big_integer::operator|=(big_integer_view rhs) {
+    bit_op(rhs, bit_or);
+    return *this;
+}
+
+big_integer &big_integer::operator^=(big_integer_view rhs) {
+    bit_op(rhs, bit_xor);
+    return *this;
+}
+
+// ~a == -a - 1
 big_integer big_integer::operator~() const {
-    big_integer r = *this;
-    r.to_twos_complement();
-    for (size_t i = 0; i < r.data.size(); ++i) {
-        r.data[i] = ~r.data[i];
-    }
-    r.is_negate = !r.is_negate;
-    r.from_twos_complement();
+    big_integer r = -*this;
+    r -= 1;
     return r;
 }
 
 big_integer &big_integer::operator<<=(int rhs) {
     assert(rhs >= 0);
+    // zero limbs shifted in under nothing would be left unnormalised
+    if (is_zero()) {
+        return *this;
+    }
     uint32_t big_offset = rhs / 32;
     uint32_t little_offset = rhs - big_offset * 32;
     if (big_offset != 0) {
         vector_shift_right(data, big_offset);
     }
     if (little_offset != 0) {
-        carry = 0;
-        for (size_t i = 0; i < data.size(); ++i) {
-            data[i] = bit_shl(data[i], little_offset);
-        }
-        if (carry != 0) {
-            data.push_back(carry);
+        limb_span a = data.span();
+        uint32_t out = mpn::lshift(a.data, a.data, a.size, little_offset);
+        if (out != 0) {
+            data.push_back(out);
         }
     }
     return *this;
@@ -412,13 +487,14 @@ big_integer &big_integer::operator>>=(int rhs) {
     }
     bool rounding_flag = false;
     if (is_negate) {
+        const_limb_span a = std::as_const(data).span();
         for (size_t i = 0; i < big_offset; ++i) {
-            if (data[i] != 0) {
+            if (a.data[i] != 0) {
                 rounding_flag = true;
                 break;
             }
         }
-        if ((data[big_offset] << (32 - little_offset)) != 0) {
+        if (little_offset != 0 && (a.data[big_offset] << (32 - little_offset)) != 0) {
             rounding_flag = true;
         }
     }
@@ -426,11 +502,8 @@ big_integer &big_integer::operator>>=(int rhs) {
         vector_shift_left(data, big_offset);
     }
     if (little_offset != 0) {
-        for (size_t i = 0; i < data.size() - 1; ++i) {
-            data[i] >>= little_offset;
-            data[i] += data[i + 1] << (32 - little_offset);
-        }
-        data.back() >>= little_offset;
+        limb_span a = data.span();
+        mpn::rshift(a.data, a.data, a.size, little_offset);
     }
     sift_zeros();
     if (rounding_flag) {
@@ -475,6 +548,38 @@ big_integer operator^(big_integer a, big_integer const &b) {
     return a ^= b;
 }
 
+big_integer operator+(big_integer a, big_integer_view b) {
+    return a += b;
+}
+
+big_integer operator-(big_integer a, big_integer_view b) {
+    return a -= b;
+}
+
+big_integer operator*(big_integer a, big_integer_view b) {
+    return a *= b;
+}
+
+big_integer operator/(big_integer a, big_integer_view b) {
+    return a /= b;
+}
+
+big_integer operator%(big_integer a, big_integer_view b) {
+    return a %= b;
+}
+
+big_integer operator&(big_integer a, big_integer_view b) {
+    return a &= b;
+}
+
+big_integer operator|(big_integer a, big_integer_view b) {
+    return a |= b;
+}
+
+big_integer operator^(big_integer a, big_integer_view b) {
+    return a ^= b;
+}
+
 big_integer operator<<(big_integer a, int b) {
     return a <<= b;
 }
@@ -487,41 +592,790 @@ big_integer operator>>(big_integer a, int b) {
 //===================for=out=======================
 //=================================================
 
-std::string to_string(big_integer const &a) {
-    if (a.is_zero()) {
-        return "0";
+const char digit_chars[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+
+int digit_value(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    } else if (c >= 'a' && c <= 'z') {
+        return c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'Z') {
+        return c - 'A' + 10;
     }
-    if (a.data.size() == 1) {
-        return std::to_string(a.data[0]);
+    return 36;
+}
+
+// largest power of base that fits in one limb
+uint32_t chunk_power(int base, size_t &digits) {
+    uint64_t power = base;
+    digits = 1;
+    while (power * base <= UINT32_MAX) {
+        power *= base;
+        ++digits;
     }
-    std::string str;
-    big_integer copy = a;
-    if (copy.is_negate) {
-        str += "-";
-        copy.is_negate = false;
+    return static_cast<uint32_t>(power);
+}
+
+int log2_base(int base) {
+    int r = 0;
+    while ((1 << r) < base) {
+        ++r;
     }
-    std::vector<std::string> buf;
-    while (!copy.is_zero()) {
-        buf.push_back(to_string(copy % 1000000000));
-        copy /= 1000000000;
+    return (1 << r) == base ? r : 0;
+}
+
+// zero limbs on top of a view don't count
+size_t bit_length(big_integer_view v) {
+    size_t n = v.size;
+    while (n != 0 && v.limbs[n - 1] == 0) {
+        --n;
     }
-    str += buf.back();
-    buf.pop_back();
-    std::reverse(buf.begin(), buf.end());
-    for (const auto &s : buf) {
-        if (s.length() < 9) {
-            str += std::string(9 - s.length(), '0');
+    if (n == 0) {
+        return 0;
+    }
+    return 32 * (n - 1) + (32 - find_d(v.limbs[n - 1]));
+}
+
+uint32_t get_bits(big_integer_view v, size_t pos, int count) {
+    size_t i = pos / 32;
+    size_t offset = pos % 32;
+    uint32_t r = v.limbs[i] >> offset;
+    if (offset + count > 32 && i + 1 < v.size) {
+        r |= v.limbs[i + 1] << (32 - offset);
+    }
+    return r & ((1u << count) - 1);
+}
+
+size_t to_chars_size(big_integer const &a, int base) {
+    return to_chars_size(big_integer_view(a), base);
+}
+
+size_t to_chars_size(big_integer_view a, int base) {
+    assert(base >= 2 && base <= 36);
+    if (a.size == 0) {
+        return 1;
+    }
+    size_t sign = a.negative ? 1 : 0;
+    size_t bits = bit_length(a);
+    int shift = log2_base(base);
+    if (shift != 0) {
+        return sign + (bits + shift - 1) / shift;
+    }
+    return sign + static_cast<size_t>(bits * (std::log(2.0) / std::log(base))) + 2;
+}
+
+std::to_chars_result to_chars(char *first, char *last, big_integer const &a, int base) {
+    return to_chars(first, last, big_integer_view(a), base);
+}
+
+std::to_chars_result to_chars(char *first, char *last, big_integer_view a, int base) {
+    assert(base >= 2 && base <= 36);
+    if (first == last) {
+        return {last, std::errc::value_too_large};
+    }
+    if (a.size == 0) {
+        *first = '0';
+        return {first + 1, std::errc()};
+    }
+    if (a.negative) {
+        *first++ = '-';
+    }
+
+    int shift = log2_base(base);
+    if (shift != 0) {
+        size_t count = (bit_length(a) + shift - 1) / shift;
+        if (static_cast<size_t>(last - first) < count) {
+            return {last, std::errc::value_too_large};
+        }
+        for (size_t i = 0; i < count; ++i) {
+            first[i] = digit_chars[get_bits(a, (count - 1 - i) * shift, shift)];
+        }
+        return {first + count, std::errc()};
+    }
+
+    // digits come out least significant first, so they are written from the end of the buffer
+    size_t chunk_digits;
+    uint32_t chunk = chunk_power(base, chunk_digits);
+    scratch_frame frame;
+    uint32_t *rest = frame.allocate(a.size);
+    size_t n = a.size;
+    std::memcpy(rest, a.limbs, sizeof(uint32_t) * n);
+    char *p = last;
+    while (n != 0) {
+        uint32_t r = mpn::divrem_1(rest, rest, n, chunk);
+        while (n != 0 && rest[n - 1] == 0) {
+            --n;
+        }
+        for (size_t i = 0; i < chunk_digits && (r != 0 || n != 0); ++i) {
+            if (p == first) {
+                return {last, std::errc::value_too_large};
+            }
+            *--p = digit_chars[r % base];
+            r /= base;
         }
-        str += s;
     }
+    size_t count = last - p;
+    std::memmove(first, p, count);
+    return {first + count, std::errc()};
+}
+
+std::string to_string(big_integer const &a) {
+    return to_string(big_integer_view(a));
+}
+
+std::string to_string(big_integer_view a) {
+    std::string str(to_chars_size(a, 10), '\0');
+    std::to_chars_result result = to_chars(&str[0], &str[0] + str.size(), a, 10);
+    str.resize(result.ptr - str.data());
     return str;
 }
 
+int stream_base(std::ios_base const &s) {
+    switch (s.flags() & std::ios_base::basefield) {
+        case std::ios_base::hex:
+            return 16;
+        case std::ios_base::oct:
+            return 8;
+        default:
+            return 10;
+    }
+}
+
+// buffers digits in small blocks and hands them to the stream as they are produced
+struct digit_writer {
+    std::streambuf *out;
+    bool failed = false;
+    size_t used = 0;
+    char buf[512];
+
+    explicit digit_writer(std::streambuf *out) : out(out) {}
+
+    void put(char c) {
+        if (used == sizeof(buf)) {
+            flush();
+        }
+        buf[used++] = c;
+    }
+
+    void flush() {
+        if (used != 0 && out->sputn(buf, used) != static_cast<std::streamsize>(used)) {
+            failed = true;
+        }
+        used = 0;
+    }
+};
+
+const size_t STREAM_LEAF_DIGITS = 320;
+
+// writes x >= 0 padded with zeros to `digits` digits. powers[k] is base^(chunk_digits * 2^k);
+// x is split by the power of about half its length, so blocks come out most significant first
+// and the text never exists as a whole
+void write_digits(digit_writer &w, big_integer const &x, size_t digits, int base,
+                  size_t chunk_digits, std::vector<big_integer> const &powers) {
+    size_t size = to_chars_size(x, base);
+    if (size <= STREAM_LEAF_DIGITS) {
+        char tmp[STREAM_LEAF_DIGITS];
+        char *end = to_chars(tmp, tmp + size, x, base).ptr;
+        for (size_t i = end - tmp; i < digits; ++i) {
+            w.put('0');
+        }
+        for (char *p = tmp; p != end; ++p) {
+            w.put(*p);
+        }
+        return;
+    }
+
+    size_t level = powers.size() - 1;
+    while (level > 0 && (chunk_digits << level) * 2 > size) {
+        --level;
+    }
+    big_integer q = x / powers[level];
+    big_integer r = x - q * powers[level];
+    size_t low_digits = chunk_digits << level;
+    write_digits(w, q, digits > low_digits ? digits - low_digits : 0, base, chunk_digits, powers);
+    write_digits(w, r, low_digits, base, chunk_digits, powers);
+}
+
 std::ostream &operator<<(std::ostream &s, big_integer const &a) {
-    s << to_string(a);
+    std::ostream::sentry sentry(s);
+    if (!sentry) {
+        return s;
+    }
+    int base = stream_base(s);
+    digit_writer w(s.rdbuf());
+    // to_chars_size overshoots decimal lengths by up to 2, so only numbers that short can need padding;
+    // they are written out first to know their exact length
+    size_t width = s.width() > 0 ? static_cast<size_t>(s.width()) : 0;
+    if (width != 0 && width + 2 > to_chars_size(a, base)) {
+        std::string digits(to_chars_size(a, base), '\0');
+        digits.resize(to_chars(&digits[0], &digits[0] + digits.size(), a, base).ptr - digits.data());
+        size_t padding = width > digits.size() ? width - digits.size() : 0;
+        bool left = (s.flags() & std::ios_base::adjustfield) == std::ios_base::left;
+        for (size_t i = 0; !left && i < padding; ++i) {
+            w.put(s.fill());
+        }
+        for (char c : digits) {
+            w.put(c);
+        }
+        for (size_t i = 0; left && i < padding; ++i) {
+            w.put(s.fill());
+        }
+    } else if (a.is_zero()) {
+        w.put('0');
+    } else {
+        if (a.is_negate) {
+            w.put('-');
+        }
+        int shift = log2_base(base);
+        if (shift != 0) {
+            for (size_t i = (bit_length(a) + shift - 1) / shift; i != 0; --i) {
+                w.put(digit_chars[get_bits(a, (i - 1) * shift, shift)]);
+            }
+        } else {
+            size_t chunk_digits;
+            size_t size = to_chars_size(a, base);
+            std::vector<big_integer> powers(1, big_integer(chunk_power(base, chunk_digits)));
+            while ((chunk_digits << powers.size()) * 2 <= size) {
+                powers.push_back(powers.back() * powers.back());
+            }
+            write_digits(w, a.is_negate ? -a : a, 0, base, chunk_digits, powers);
+        }
+    }
+    w.flush();
+    if (w.failed) {
+        s.setstate(std::ios_base::badbit);
+    }
+    s.width(0);
     return s;
 }
 
+//=================================================
+//===================for=in========================
+//=================================================
+
+std::from_chars_result from_chars(const char *first, const char *last, big_integer &a, int base) {
+    assert(base >= 2 && base <= 36);
+    const char *p = first;
+    bool negate = false;
+    if (p != last && *p == '-') {
+        negate = true;
+        ++p;
+    }
+    if (p == last || digit_value(*p) >= base) {
+        return {first, std::errc::invalid_argument};
+    }
+
+    digit_accumulator acc(base);
+    for (; p != last; ++p) {
+        int digit = digit_value(*p);
+        if (digit >= base) {
+            break;
+        }
+        acc.push(digit);
+    }
+
+    a.data.swap(acc.finish());
+    a.is_negate = negate;
+    a.sift_zeros();
+    return {p, std::errc()};
+}
+
+std::istream &operator>>(std::istream &s, big_integer &a) {
+    std::istream::sentry sentry(s);
+    if (!sentry) {
+        return s;
+    }
+    int base = stream_base(s);
+    std::streambuf *in = s.rdbuf();
+    typedef std::char_traits<char> traits;
+
+    bool negate = false;
+    int c = in->sgetc();
+    if (c == '-') {
+        negate = true;
+        c = in->snextc();
+    }
+    digit_accumulator acc(base);
+    bool any = false;
+    while (c != traits::eof() && digit_value(traits::to_char_type(c)) < base) {
+        acc.push(digit_value(traits::to_char_type(c)));
+        any = true;
+        c = in->snextc();
+    }
+    if (c == traits::eof()) {
+        s.setstate(std::ios_base::eofbit);
+    }
+    if (!any) {
+        s.setstate(std::ios_base::failbit);
+        return s;
+    }
+    a.data.swap(acc.finish());
+    a.is_negate = negate;
+    a.sift_zeros();
+    return s;
+}
+
+//=================================================
+//=================serialization===================
+//=================================================
+
+const uint8_t SERIALIZATION_VERSION = 1;
+const size_t SERIALIZATION_HEADER = 12;
+
+bool is_little_endian() {
+    fast_split_ull helper;
+    helper.ull = 1;
+    return helper.u[0] == 1;
+}
+
+void store_le(uint8_t *out, uint64_t v, size_t bytes) {
+    for (size_t i = 0; i < bytes; ++i) {
+        out[i] = static_cast<uint8_t>(v >> (8 * i));
+    }
+}
+
+uint64_t load_le(uint8_t const *in, size_t bytes) {
+    uint64_t v = 0;
+    for (size_t i = 0; i < bytes; ++i) {
+        v |= static_cast<uint64_t>(in[i]) << (8 * i);
+    }
+    return v;
+}
+
+void write_header(uint8_t *out, big_integer const &a, size_t limbs) {
+    out[0] = SERIALIZATION_VERSION;
+    out[1] = a < 0 ? 1 : 0;
+    out[2] = 0;
+    out[3] = 0;
+    store_le(out + 4, limbs, 8);
+}
+
+// returns the limb count
+uint64_t read_header(uint8_t const *in, bool &negate) {
+    if (in[0] != SERIALIZATION_VERSION || in[1] > 1 || in[2] != 0 || in[3] != 0) {
+        throw std::runtime_error("invalid binary format");
+    }
+    negate = in[1] == 1;
+    return load_le(in + 4, 8);
+}
+
+void copy_limbs_out(uint8_t *out, uint32_t const *limbs, size_t count) {
+    if (is_little_endian()) {
+        std::memcpy(out, limbs, sizeof(uint32_t) * count);
+    } else {
+        for (size_t i = 0; i < count; ++i) {
+            store_le(out + sizeof(uint32_t) * i, limbs[i], sizeof(uint32_t));
+        }
+    }
+}
+
+void copy_limbs_in(uint32_t *limbs, uint8_t const *in, size_t count) {
+    if (is_little_endian()) {
+        std::memcpy(limbs, in, sizeof(uint32_t) * count);
+    } else {
+        for (size_t i = 0; i < count; ++i) {
+            limbs[i] = static_cast<uint32_t>(load_le(in + sizeof(uint32_t) * i, sizeof(uint32_t)));
+        }
+    }
+}
+
+size_t serialized_size(big_integer const &a) {
+    return SERIALIZATION_HEADER + sizeof(uint32_t) * a.data.size();
+}
+
+size_t serialize(big_integer const &a, uint8_t *out) {
+    write_header(out, a, a.data.size());
+    copy_limbs_out(out + SERIALIZATION_HEADER, a.data.data(), a.data.size());
+    return serialized_size(a);
+}
+
+std::vector<uint8_t> serialize(big_integer const &a) {
+    std::vector<uint8_t> out(serialized_size(a));
+    serialize(a, out.data());
+    return out;
+}
+
+std::ostream &serialize(std::ostream &s, big_integer const &a) {
+    uint8_t header[SERIALIZATION_HEADER];
+    write_header(header, a, a.data.size());
+    s.write(reinterpret_cast<const char *>(header), SERIALIZATION_HEADER);
+    if (is_little_endian()) {
+        s.write(reinterpret_cast<const char *>(a.data.data()), sizeof(uint32_t) * a.data.size());
+    } else {
+        uint8_t limb[sizeof(uint32_t)];
+        const_limb_span limbs = a.data.span();
+        for (size_t i = 0; i < limbs.size; ++i) {
+            store_le(limb, limbs.data[i], sizeof(uint32_t));
+            s.write(reinterpret_cast<const char *>(limb), sizeof(uint32_t));
+        }
+    }
+    return s;
+}
+
+big_integer deserialize(uint8_t const *in, size_t size) {
+    if (size < SERIALIZATION_HEADER) {
+        throw std::runtime_error("invalid binary format");
+    }
+    bool negate;
+    uint64_t count = read_header(in, negate);
+    if (count > (size - SERIALIZATION_HEADER) / sizeof(uint32_t)) {
+        throw std::runtime_error("invalid binary format");
+    }
+    big_integer r;
+    r.data.resize(count, no_init);
+    copy_limbs_in(r.data.data(), in + SERIALIZATION_HEADER, count);
+    r.is_negate = negate;
+    r.sift_zeros();
+    return r;
+}
+
+// limbs read from a stream at a time, so the vector only grows as far as the bytes that actually arrive
+const size_t DESERIALIZE_CHUNK = 1 << 16;
+
+big_integer deserialize(std::istream &s) {
+    uint8_t header[SERIALIZATION_HEADER];
+    if (!s.read(reinterpret_cast<char *>(header), SERIALIZATION_HEADER)) {
+        throw std::runtime_error("invalid binary format");
+    }
+    bool negate;
+    uint64_t count = read_header(header, negate);
+    if (count > (SIZE_MAX - SERIALIZATION_HEADER) / sizeof(uint32_t)) {
+        throw std::runtime_error("invalid binary format");
+    }
+    big_integer r;
+    for (size_t done = 0; done < count;) {
+        size_t n = std::min<uint64_t>(count - done, DESERIALIZE_CHUNK);
+        r.data.resize(done + n, no_init);
+        uint32_t *limbs = r.data.data() + done;
+        if (!s.read(reinterpret_cast<char *>(limbs), sizeof(uint32_t) * n)) {
+            throw std::runtime_error("invalid binary format");
+        }
+        if (!is_little_endian()) {
+            for (size_t i = 0; i < n; ++i) {
+                limbs[i] = static_cast<uint32_t>(load_le(reinterpret_cast<uint8_t const *>(limbs + i), sizeof(uint32_t)));
+            }
+        }
+        done += n;
+    }
+    r.is_negate = negate;
+    r.sift_zeros();
+    return r;
+}
+
+void write_file(std::string const &path, big_integer const &a) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!serialize(out, a) || !out.flush()) {
+        throw std::runtime_error("can't write " + path);
+    }
+}
+
+// the mapping is owned here until the smart_vector that releases it exists, so a throw on the way
+// (a bad header, or the budget rejecting the storage header) unmaps it
+big_integer map_file(std::string const &path) {
+    std::unique_ptr<mapped_file> file(new mapped_file(path));
+    if (file->size() < SERIALIZATION_HEADER) {
+        throw std::runtime_error("invalid binary format");
+    }
+    bool negate;
+    uint64_t count = read_header(file->data(), negate);
+    if (count > (file->size() - SERIALIZATION_HEADER) / sizeof(uint32_t)) {
+        throw std::runtime_error("invalid binary format");
+    }
+    if (!is_little_endian()) {
+        return deserialize(file->data(), file->size());
+    }
+
+    big_integer r;
+    r.data = smart_vector(reinterpret_cast<uint32_t const *>(file->data() + SERIALIZATION_HEADER), count,
+                          mapped_file::release, file.get());
+    file.release();
+    r.is_negate = negate;
+    r.sift_zeros();
+    return r;
+}
+
+//=================================================
+//=====================varint======================
+//=================================================
+
+bool is_power_of_two(const smart_vector &v) {
+    if (v.empty() || (v.back() & (v.back() - 1)) != 0) {
+        return false;
+    }
+    for (size_t i = 0; i + 1 < v.size(); ++i) {
+        if (v[i] != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// the zigzag value is 2 * |a| for a >= 0 and 2 * (|a| - 1) + 1 otherwise
+size_t varint_size(big_integer const &a) {
+    size_t bits = bit_length(a);
+    if (a.is_negate && is_power_of_two(a.data)) {
+        --bits;
+    }
+    return bits / 7 + 1;
+}
+
+size_t encode_varint(big_integer const &a, uint8_t *out) {
+    size_t n = varint_size(a);
+    uint32_t const *limbs = a.data.data();
+    size_t size = a.data.size();
+    uint32_t borrow = a.is_negate ? 1 : 0;
+    uint64_t acc = borrow;
+    int bits = 1;
+    size_t i = 0;
+    for (size_t k = 0; k < n; ++k) {
+        if (bits < 7 && i < size) {
+            uint32_t limb = limbs[i++];
+            acc |= static_cast<uint64_t>(limb - borrow) << bits;
+            borrow = limb < borrow ? 1 : 0;
+            bits += 32;
+        }
+        out[k] = static_cast<uint8_t>((acc & 0x7f) | (k + 1 < n ? 0x80 : 0));
+        acc >>= 7;
+        bits -= 7;
+    }
+    return n;
+}
+
+size_t decode_varint(uint8_t const *in, size_t size, big_integer &a) {
+    size_t n = 0;
+    while (n < size && (in[n] & 0x80) != 0) {
+        ++n;
+    }
+    if (n == size) {
+        throw std::runtime_error("truncated varint");
+    }
+    ++n;
+
+    bool negate = (in[0] & 1) != 0;
+    smart_vector result((7 * n - 1 + 31) / 32, no_init);
+    uint32_t *limbs = result.data();
+    uint64_t acc = (in[0] & 0x7f) >> 1;
+    int bits = 6;
+    size_t j = 0;
+    for (size_t k = 1; k < n; ++k) {
+        acc |= static_cast<uint64_t>(in[k] & 0x7f) << bits;
+        bits += 7;
+        if (bits >= 32) {
+            limbs[j++] = static_cast<uint32_t>(acc);
+            acc >>= 32;
+            bits -= 32;
+        }
+    }
+    if (j < result.size()) {
+        limbs[j] = static_cast<uint32_t>(acc);
+    }
+    if (negate) {
+        vector_mul_add_short(result, 1, 1);
+    }
+
+    a.data.swap(result);
+    a.is_negate = negate;
+    a.sift_zeros();
+    return n;
+}
+
+//=================================================
+//==================order=keys=====================
+//=================================================
+
+// header byte: 0x80 for zero, 0x80 + n / 0x80 - n for n <= ORDER_KEY_SHORT limbs,
+// 0xff / 0x01 followed by the big-endian 64-bit count (complemented if negative) otherwise
+const uint8_t ORDER_KEY_ZERO = 0x80;
+const size_t ORDER_KEY_SHORT = 126;
+
+size_t order_key_size(big_integer const &a) {
+    size_t n = a.data.size();
+    return 1 + (n > ORDER_KEY_SHORT ? 8 : 0) + 4 * n;
+}
+
+size_t encode_order_key(big_integer const &a, uint8_t *out) {
+    size_t n = a.data.size();
+    uint32_t mask = a.is_negate ? UINT32_MAX : 0;
+    uint8_t *p = out;
+    if (n == 0) {
+        *p++ = ORDER_KEY_ZERO;
+    } else if (n <= ORDER_KEY_SHORT) {
+        *p++ = static_cast<uint8_t>(a.is_negate ? ORDER_KEY_ZERO - n : ORDER_KEY_ZERO + n);
+    } else {
+        *p++ = a.is_negate ? 0x01 : 0xff;
+        uint64_t count = a.is_negate ? ~static_cast<uint64_t>(n) : n;
+        for (int i = 7; i >= 0; --i) {
+            *p++ = static_cast<uint8_t>(count >> (8 * i));
+        }
+    }
+    uint32_t const *limbs = a.data.data();
+    for (size_t i = n; i != 0; --i) {
+        uint32_t limb = limbs[i - 1] ^ mask;
+        p[0] = static_cast<uint8_t>(limb >> 24);
+        p[1] = static_cast<uint8_t>(limb >> 16);
+        p[2] = static_cast<uint8_t>(limb >> 8);
+        p[3] = static_cast<uint8_t>(limb);
+        p += 4;
+    }
+    return p - out;
+}
+
+std::string order_key(big_integer const &a) {
+    std::string key(order_key_size(a), '\0');
+    encode_order_key(a, reinterpret_cast<uint8_t *>(&key[0]));
+    return key;
+}
+
+big_integer decode_order_key(uint8_t const *in, size_t size) {
+    if (size == 0) {
+        throw std::runtime_error("invalid order key");
+    }
+    uint8_t head = in[0];
+    bool negate = head < ORDER_KEY_ZERO;
+    size_t skip = 1;
+    uint64_t n;
+    if (head == 0x01 || head == 0xff) {
+        if (size < 9) {
+            throw std::runtime_error("invalid order key");
+        }
+        n = 0;
+        for (size_t i = 1; i < 9; ++i) {
+            n = (n << 8) | in[i];
+        }
+        if (negate) {
+            n = ~n;
+        }
+        skip = 9;
+    } else {
+        n = negate ? ORDER_KEY_ZERO - head : head - ORDER_KEY_ZERO;
+    }
+    if (head == 0 || n > (size - skip) / 4 || size - skip != 4 * n) {
+        throw std::runtime_error("invalid order key");
+    }
+
+    uint32_t mask = negate ? UINT32_MAX : 0;
+    big_integer r;
+    r.data.resize(n, no_init);
+    uint32_t *limbs = r.data.data();
+    uint8_t const *p = in + skip;
+    for (size_t i = n; i != 0; --i) {
+        uint32_t limb = (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16)
+                        | (static_cast<uint32_t>(p[2]) << 8) | p[3];
+        limbs[i - 1] = limb ^ mask;
+        p += 4;
+    }
+    r.is_negate = negate;
+    r.sift_zeros();
+    return r;
+}
+
+//=================================================
+//=================import/export===================
+//=================================================
+
+// calls f(offset, j) for every byte of a count * size layout, where offset is the byte position
+// in memory and j the index of the byte in the value, least significant first
+template<class FunctorT>
+void walk_words(size_t count, size_t size, word_order order, byte_order endian, const FunctorT &f) {
+    bool big = endian == byte_order::big || (endian == byte_order::native && !is_little_endian());
+    size_t j = 0;
+    for (size_t w = 0; w < count; ++w) {
+        size_t word = order == word_order::least_significant_first ? w : count - 1 - w;
+        for (size_t b = 0; b < size; ++b, ++j) {
+            f(word * size + (big ? size - 1 - b : b), j);
+        }
+    }
+}
+
+uint8_t limb_byte(uint32_t const *limbs, size_t n, size_t j) {
+    return j / 4 < n ? static_cast<uint8_t>(limbs[j / 4] >> (8 * (j % 4))) : 0;
+}
+
+void read_words(void const *in, size_t count, size_t size,
+                word_order order, byte_order endian, smart_vector &out) {
+    uint8_t const *bytes = static_cast<uint8_t const *>(in);
+    out.resize((count * size + 3) / 4);
+    uint32_t *limbs = out.data();
+    walk_words(count, size, order, endian, [&](size_t offset, size_t j) {
+        limbs[j / 4] |= static_cast<uint32_t>(bytes[offset]) << (8 * (j % 4));
+    });
+}
+
+big_integer import_words(void const *in, size_t count, size_t size,
+                         word_order order, byte_order endian) {
+    big_integer r;
+    read_words(in, count, size, order, endian, r.data);
+    r.sift_zeros();
+    return r;
+}
+
+big_integer import_twos_complement(void const *in, size_t count, size_t size,
+                                   word_order order, byte_order endian) {
+    big_integer r;
+    read_words(in, count, size, order, endian, r.data);
+    size_t bytes = count * size;
+    if (bytes != 0 && (r.data[(bytes - 1) / 4] >> (8 * ((bytes - 1) % 4) + 7)) != 0) {
+        // magnitude is 2^(8 * bytes) - raw, i.e. ~raw + 1 cut to the width
+        uint32_t *limbs = r.data.data();
+        uint64_t rest = 1;
+        for (size_t i = 0; i < r.data.size(); ++i) {
+            rest += static_cast<uint32_t>(~limbs[i]);
+            limbs[i] = static_cast<uint32_t>(rest);
+            rest >>= 32;
+        }
+        if (bytes % 4 != 0) {
+            r.data.back() &= (1u << (8 * (bytes % 4))) - 1;
+        }
+        r.is_negate = true;
+    }
+    r.sift_zeros();
+    return r;
+}
+
+size_t export_size(big_integer const &a, size_t size) {
+    return (bit_length(a) + 8 * size - 1) / (8 * size);
+}
+
+size_t export_words(void *out, size_t size, word_order order, byte_order endian,
+                    big_integer const &a) {
+    uint8_t *bytes = static_cast<uint8_t *>(out);
+    uint32_t const *limbs = a.data.data();
+    size_t n = a.data.size();
+    size_t count = export_size(a, size);
+    walk_words(count, size, order, endian, [&](size_t offset, size_t j) {
+        bytes[offset] = limb_byte(limbs, n, j);
+    });
+    return count;
+}
+
+bool export_twos_complement(void *out, size_t count, size_t size,
+                            word_order order, byte_order endian, big_integer const &a) {
+    size_t width = 8 * count * size;
+    size_t bits = bit_length(a);
+    if (bits >= width) {
+        // only -2^(width - 1) has a magnitude of width bits and still fits
+        if (!a.is_negate || bits != width || !is_power_of_two(a.data)) {
+            return false;
+        }
+    }
+    uint8_t *bytes = static_cast<uint8_t *>(out);
+    uint32_t const *limbs = a.data.data();
+    size_t n = a.data.size();
+    if (a.is_negate) {
+        unsigned rest = 1;
+        walk_words(count, size, order, endian, [&](size_t offset, size_t j) {
+            rest += static_cast<uint8_t>(~limb_byte(limbs, n, j));
+            bytes[offset] = static_cast<uint8_t>(rest);
+            rest >>= 8;
+        });
+    } else {
+        walk_words(count, size, order, endian, [&](size_t offset, size_t j) {
+            bytes[offset] = limb_byte(limbs, n, j);
+        });
+    }
+    return true;
+}
+
 //=================================================
 //=====================other=======================
 //=================================================
@@ -566,9 +1420,12 @@ const big_integer big_integer::operator--(int) {
 //=================================================
 
 void big_integer::sift_zeros() {
-    while (!data.empty() && data.back() == 0) {
-        data.pop_back();
+    const_limb_span a = std::as_const(data).span();
+    size_t n = a.size;
+    while (n != 0 && a.data[n - 1] == 0) {
+        --n;
     }
+    data.resize(n, no_init);
     if (is_zero()) {
         is_negate = false;
     }
@@ -578,78 +1435,73 @@ bool big_integer::is_zero() const {
     return data.empty();
 }
 
-int vector_compare(const smart_vector &a, const smart_vector &b) {
-    if (a.size() < b.size()) {
+int magnitude_compare(big_integer_view a, big_integer_view b) {
+    if (a.size < b.size) {
         return -1;
     }
-    if (a.size() > b.size()) {
+    if (a.size > b.size) {
         return 1;
     }
-
-    for (size_t i = a.size(); i != 0; --i) {
-        if (a[i - 1] != b[i - 1]) {
-            if (a[i - 1] < b[i - 1]) {
-                return -1;
-            } else {
-                return 1;
-            }
-        }
-    }
-    return 0;
+    return mpn::cmp(a.limbs, b.limbs, a.size);
 }
 
 void vector_shift_right(smart_vector &resource, size_t offset) {
-    resource.resize(resource.size() + offset);
-    for (size_t i = resource.size(); i != offset; --i) {
-        resource[i - 1] = resource[i - 1 - offset];
-    }
-    for (size_t i = 0; i < offset; ++i) {
-        resource[i] = 0;
-    }
+    resource.resize(resource.size() + offset, no_init);
+    limb_span a = resource.span();
+    std::memmove(a.data + offset, a.data, sizeof(uint32_t) * (a.size - offset));
+    std::memset(a.data, 0, sizeof(uint32_t) * offset);
 }
 
 void vector_shift_left(smart_vector &resource, size_t offset) {
-    for (size_t i = 0; i < resource.size() - offset; ++i) {
-        resource[i] = resource[i + offset];
-    }
-    resource.resize(resource.size() - offset);
+    limb_span a = resource.span();
+    std::memmove(a.data, a.data + offset, sizeof(uint32_t) * (a.size - offset));
+    resource.resize(a.size - offset, no_init);
 }
 
-void big_integer::to_twos_complement() {
-    if (is_negate) {
-        for (size_t i = 0; i < data.size(); ++i) {
-            data[i] = ~data[i];
-        }
-        *this -= 1;
+void vector_mul_add_short(smart_vector &resource, uint32_t multiplier, uint32_t addend) {
+    limb_span a = resource.span();
+    uint32_t high = mpn::mul_1(a.data, a.data, a.size, multiplier);
+    high += mpn::add_1(a.data, a.data, a.size, addend);
+    if (high != 0) {
+        resource.push_back(high);
     }
 }
 
-void big_integer::from_twos_complement() {
-    if (is_negate) {
-        *this += 1;
-        for (size_t i = 0; i < data.size(); ++i) {
-            data[i] = ~data[i];
-        }
+// operands of this many limbs go to the fixed-size kernels of mpn_small.h
+bool is_small(size_t n) {
+    return n >= mpn::small_min && n <= mpn::small_max;
+}
+
+// v zero-extended to n limbs, in buf unless it already has them
+uint32_t const *padded(big_integer_view v, size_t n, uint32_t *buf) {
+    if (v.size == n) {
+        return v.limbs;
     }
-    sift_zeros();
+    std::memcpy(buf, v.limbs, sizeof(uint32_t) * v.size);
+    std::memset(buf + v.size, 0, sizeof(uint32_t) * (n - v.size));
+    return buf;
 }
 
-int compare(const big_integer &a, const big_integer &b) {
-    if (a.is_negate) {
-        if (b.is_negate) {
-            return vector_compare(a.data, b.data) * -1;
+int compare(big_integer_view a, big_integer_view b) {
+    if (a.negative) {
+        if (b.negative) {
+            return magnitude_compare(a, b) * -1;
         } else {
             return -1;
         }
     } else {
-        if (b.is_negate) {
+        if (b.negative) {
             return 1;
         } else {
-            return vector_compare(a.data, b.data);
+            return magnitude_compare(a, b);
         }
     }
 }
 
+int compare(const big_integer &a, const big_integer &b) {
+    return compare(big_integer_view(a), big_integer_view(b));
+}
+
 
 //=================================================
 //=================================================
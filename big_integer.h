@@ -4,9 +4,39 @@
 #include <cstddef>
 #include <iosfwd>
 #include <cstdint>
-//#include <vector>
+#include <string>
+#include <charconv>
+#include <vector>
 #include "utils/smart_vector.h"
 
+enum class word_order {
+    most_significant_first,
+    least_significant_first
+};
+
+enum class byte_order {
+    big,
+    little,
+    native
+};
+
+struct big_integer;
+
+// non-owning read-only value over limbs stored elsewhere, least significant first.
+// The limbs must outlive the view and must not belong to the value it is applied to
+struct big_integer_view {
+    uint32_t const *limbs;
+    size_t size;
+    bool negative;
+
+    // leading zero limbs are dropped
+    big_integer_view(uint32_t const *limbs, size_t size, bool negative = false);
+
+    big_integer_view(big_integer const &a);
+
+    big_integer_view operator-() const;
+};
+
 struct big_integer {
     big_integer() = default;
 
@@ -18,26 +48,51 @@ struct big_integer {
 
     explicit big_integer(std::string const &str);
 
+    explicit big_integer(big_integer_view v);
+
     ~big_integer() = default;
 
     big_integer &operator=(big_integer const &other) = default;
 
+    // in 32-bit limbs; reserving ahead keeps growing loops from reallocating
+    size_t capacity() const;
+
+    void reserve(size_t limbs);
+
+    void shrink_to_fit();
+
     big_integer &operator+=(big_integer const &rhs);
 
+    big_integer &operator+=(big_integer_view rhs);
+
     big_integer &operator-=(big_integer const &rhs);
 
+    big_integer &operator-=(big_integer_view rhs);
+
     big_integer &operator*=(big_integer const &rhs);
 
+    big_integer &operator*=(big_integer_view rhs);
+
     big_integer &operator/=(big_integer const &rhs);
 
+    big_integer &operator/=(big_integer_view rhs);
+
     big_integer &operator%=(big_integer const &rhs);
 
+    big_integer &operator%=(big_integer_view rhs);
+
     big_integer &operator&=(big_integer const &rhs);
 
+    big_integer &operator&=(big_integer_view rhs);
+
     big_integer &operator|=(big_integer const &rhs);
 
+    big_integer &operator|=(big_integer_view rhs);
+
     big_integer &operator^=(big_integer const &rhs);
 
+    big_integer &operator^=(big_integer_view rhs);
+
     big_integer &operator<<=(int rhs);
 
     big_integer &operator>>=(int rhs);
@@ -70,7 +125,53 @@ struct big_integer {
 
     friend std::string to_string(big_integer const &a);
 
+    friend std::from_chars_result from_chars(const char *first, const char *last, big_integer &a, int base);
+
+    friend std::ostream &operator<<(std::ostream &s, big_integer const &a);
+
+    friend std::istream &operator>>(std::istream &s, big_integer &a);
+
+    friend size_t serialized_size(big_integer const &a);
+
+    friend size_t serialize(big_integer const &a, uint8_t *out);
+
+    friend std::ostream &serialize(std::ostream &s, big_integer const &a);
+
+    friend big_integer deserialize(uint8_t const *in, size_t size);
+
+    friend big_integer deserialize(std::istream &s);
+
+    friend big_integer map_file(std::string const &path);
+
+    friend big_integer import_words(void const *in, size_t count, size_t size,
+                                    word_order order, byte_order endian);
+
+    friend big_integer import_twos_complement(void const *in, size_t count, size_t size,
+                                              word_order order, byte_order endian);
+
+    friend size_t export_size(big_integer const &a, size_t size);
+
+    friend size_t varint_size(big_integer const &a);
+
+    friend size_t encode_varint(big_integer const &a, uint8_t *out);
+
+    friend size_t decode_varint(uint8_t const *in, size_t size, big_integer &a);
+
+    friend size_t order_key_size(big_integer const &a);
+
+    friend size_t encode_order_key(big_integer const &a, uint8_t *out);
+
+    friend big_integer decode_order_key(uint8_t const *in, size_t size);
+
+    friend size_t export_words(void *out, size_t size, word_order order, byte_order endian,
+                               big_integer const &a);
+
+    friend bool export_twos_complement(void *out, size_t count, size_t size,
+                                       word_order order, byte_order endian, big_integer const &a);
+
 private:
+    friend struct big_integer_view;
+
     smart_vector data;
     //std::vector<uint32_t> data;
     bool is_negate = false;
@@ -81,33 +182,43 @@ private:
 
     friend int compare(const big_integer &a, const big_integer &b);
 
-    void to_twos_complement();
-
-    void from_twos_complement();
-
+    // *this = *this op rhs on the two's complement forms, in one pass over the sign-magnitude limbs.
+    // A negative magnitude m reads as ~m + 1, the + 1 carried up as long as m's limbs are zero, and a
+    // negative result is turned back the same way; above its limbs an operand is all sign bits
     template<class FunctorT>
-    void bit_op(big_integer assistant, const FunctorT &op) {
-        if (data.size() < assistant.data.size()) {
-            data.resize(assistant.data.size());
-        } else {
-            assistant.data.resize(data.size());
+    void bit_op(big_integer_view rhs, const FunctorT &op) {
+        bool negative = op(is_negate, rhs.negative);
+        uint32_t a_mask = is_negate ? UINT32_MAX : 0;
+        uint32_t b_mask = rhs.negative ? UINT32_MAX : 0;
+        uint32_t r_mask = negative ? UINT32_MAX : 0;
+        uint64_t a_carry = is_negate, b_carry = rhs.negative, r_carry = negative;
+
+        data.resize(std::max(data.size(), rhs.size));
+        limb_span a = data.span();
+        size_t i = 0;
+        for (; i < a.size && (a_carry | b_carry | r_carry) != 0; ++i) {
+            a_carry += a.data[i] ^ a_mask;
+            b_carry += (i < rhs.size ? rhs.limbs[i] : 0) ^ b_mask;
+            r_carry += op(static_cast<uint32_t>(a_carry), static_cast<uint32_t>(b_carry)) ^ r_mask;
+            a.data[i] = static_cast<uint32_t>(r_carry);
+            a_carry >>= 32;
+            b_carry >>= 32;
+            r_carry >>= 32;
         }
-
-        to_twos_complement();
-        assistant.to_twos_complement();
-
-        data.resize(std::max(data.size(), assistant.data.size()));
-        for (size_t i = 0; i < data.size(); ++i) {
-            if (i < assistant.data.size()) {
-                data[i] = op(data[i], assistant.data[i]);
-            } else {
-                data[i] = op(data[i], 0);
-            }
+        // the + 1s stop at the first nonzero limb, from there on the limbs are only complemented
+        size_t common = std::min(a.size, rhs.size);
+        for (; i < common; ++i) {
+            a.data[i] = op(a.data[i] ^ a_mask, rhs.limbs[i] ^ b_mask) ^ r_mask;
         }
-
-        is_negate = op(is_negate, assistant.is_negate);
-
-        from_twos_complement();
+        for (; i < a.size; ++i) {
+            a.data[i] = op(a.data[i] ^ a_mask, b_mask) ^ r_mask;
+        }
+        // a negative result whose limbs all came out zero is -2^(32 * size)
+        if (r_carry != 0) {
+            data.push_back(static_cast<uint32_t>(r_carry));
+        }
+        is_negate = negative;
+        sift_zeros();
     }
 };
 
@@ -127,6 +238,22 @@ big_integer operator|(big_integer a, big_integer const &b);
 
 big_integer operator^(big_integer a, big_integer const &b);
 
+big_integer operator+(big_integer a, big_integer_view b);
+
+big_integer operator-(big_integer a, big_integer_view b);
+
+big_integer operator*(big_integer a, big_integer_view b);
+
+big_integer operator/(big_integer a, big_integer_view b);
+
+big_integer operator%(big_integer a, big_integer_view b);
+
+big_integer operator&(big_integer a, big_integer_view b);
+
+big_integer operator|(big_integer a, big_integer_view b);
+
+big_integer operator^(big_integer a, big_integer_view b);
+
 big_integer operator<<(big_integer a, int b);
 
 big_integer operator>>(big_integer a, int b);
@@ -143,8 +270,104 @@ bool operator<=(big_integer const &a, big_integer const &b);
 
 bool operator>=(big_integer const &a, big_integer const &b);
 
+bool operator==(big_integer const &a, big_integer_view b);
+
+bool operator!=(big_integer const &a, big_integer_view b);
+
+bool operator<(big_integer const &a, big_integer_view b);
+
+bool operator>(big_integer const &a, big_integer_view b);
+
+bool operator<=(big_integer const &a, big_integer_view b);
+
+bool operator>=(big_integer const &a, big_integer_view b);
+
 std::string to_string(big_integer const &a);
 
+std::string to_string(big_integer_view a);
+
+// upper bound of the characters to_chars writes, sign included
+size_t to_chars_size(big_integer const &a, int base = 10);
+
+size_t to_chars_size(big_integer_view a, int base = 10);
+
+// base is in [2, 36]; errors are reported through the result, nothing is thrown
+std::to_chars_result to_chars(char *first, char *last, big_integer const &a, int base = 10);
+
+std::to_chars_result to_chars(char *first, char *last, big_integer_view a, int base = 10);
+
+std::from_chars_result from_chars(const char *first, const char *last, big_integer &a, int base = 10);
+
+// digits are written to the stream block by block as the conversion produces them
 std::ostream &operator<<(std::ostream &s, big_integer const &a);
 
+std::istream &operator>>(std::istream &s, big_integer &a);
+
+// binary format, version 1: version byte, sign byte, two zero bytes,
+// 64-bit limb count and then the 32-bit limbs, everything little-endian
+size_t serialized_size(big_integer const &a);
+
+// out must have room for serialized_size(a) bytes; returns the bytes written
+size_t serialize(big_integer const &a, uint8_t *out);
+
+std::vector<uint8_t> serialize(big_integer const &a);
+
+std::ostream &serialize(std::ostream &s, big_integer const &a);
+
+// reads one value from the front of the buffer, throws std::runtime_error on malformed input
+big_integer deserialize(uint8_t const *in, size_t size);
+
+big_integer deserialize(std::istream &s);
+
+// stores a in the serialize format
+void write_file(std::string const &path, big_integer const &a);
+
+// maps a file in the serialize format and uses its limbs in place as read-only storage,
+// the first write to the value copies them; throws std::runtime_error on bad files
+big_integer map_file(std::string const &path);
+
+// LEB128 of the zigzag mapping 0, -1, 1, -2, ... -> 0, 1, 2, 3, ...
+size_t varint_size(big_integer const &a);
+
+// out must have room for varint_size(a) bytes; returns the bytes written
+size_t encode_varint(big_integer const &a, uint8_t *out);
+
+// reads one value from the front of the buffer and returns the bytes consumed,
+// throws std::runtime_error if the buffer ends inside the value
+size_t decode_varint(uint8_t const *in, size_t size, big_integer &a);
+
+// byte strings whose memcmp order is the numeric order: a header byte holding the sign and
+// the limb count, then the limbs most significant first, complemented for negative values
+size_t order_key_size(big_integer const &a);
+
+// out must have room for order_key_size(a) bytes; returns the bytes written
+size_t encode_order_key(big_integer const &a, uint8_t *out);
+
+std::string order_key(big_integer const &a);
+
+// the buffer must hold exactly one key, throws std::runtime_error otherwise
+big_integer decode_order_key(uint8_t const *in, size_t size);
+
+// mpz_import/mpz_export-like raw conversion: count words of size bytes each,
+// with the given order of words and order of bytes inside a word
+
+// reads a non-negative value
+big_integer import_words(void const *in, size_t count, size_t size,
+                         word_order order, byte_order endian);
+
+// reads a signed value stored in two's complement over all count * size bytes
+big_integer import_twos_complement(void const *in, size_t count, size_t size,
+                                   word_order order, byte_order endian);
+
+// words export_words needs for |a|, zero for zero
+size_t export_size(big_integer const &a, size_t size);
+
+// writes |a| as export_size(a, size) words and returns that count
+size_t export_words(void *out, size_t size, word_order order, byte_order endian,
+                    big_integer const &a);
+
+// writes a into exactly count words in two's complement, returns false if it does not fit
+bool export_twos_complement(void *out, size_t count, size_t size,
+                            word_order order, byte_order endian, big_integer const &a);
+
 #endif // BIG_INTEGER_H
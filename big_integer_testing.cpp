@@ -3,9 +3,19 @@
 #include <cstdlib>
 #include <vector>
 #include <utility>
+#include <sstream>
+#include <iomanip>
+#include <memory_resource>
 #include <gtest/gtest.h>
 
 #include "big_integer.h"
+#include "utils/limb_pool.h"
+#include "utils/scratch_arena.h"
+#include "utils/huge_page_resource.h"
+#include "utils/memory_budget.h"
+#include "utils/mpn.h"
+#include "utils/mpn_x86_64.h"
+#include "utils/mpn_small.h"
 
 TEST(correctness, two_plus_two)
 {
@@ -399,6 +409,64 @@ TEST(correctness, not_)
     EXPECT_TRUE(~a == (-a - 1));
 }
 
+TEST(correctness, not_limb_boundaries)
+{
+    big_integer values[] = {0, 1, -1, UINT32_MAX, (big_integer(1) << 32), (big_integer(1) << 64) - 1,
+                            -(big_integer(1) << 32), -((big_integer(1) << 96) - 1)};
+    for (big_integer const &a : values)
+    {
+        EXPECT_EQ(~a, -a - 1);
+        EXPECT_EQ(~~a, a);
+    }
+}
+
+TEST(correctness, bit_ops_signed_multi_limb)
+{
+    for (int iteration = 0; iteration != 500; ++iteration)
+    {
+        // built unsigned, where the shifts are defined, and kept below 2^63 so negating stays in range
+        uint64_t ux = ((static_cast<uint64_t>(rand()) << 33) ^ (static_cast<uint64_t>(rand()) << 11) ^ rand()) >> 1;
+        uint64_t uy = ((static_cast<uint64_t>(rand()) << 33) ^ (static_cast<uint64_t>(rand()) << 11) ^ rand()) >> 1;
+        if (rand() % 8 == 0)
+            uy &= ~uint64_t(UINT32_MAX);
+        int64_t x = static_cast<int64_t>(ux);
+        int64_t y = static_cast<int64_t>(uy);
+        if (rand() % 2 == 0)
+            x = -x;
+        if (rand() % 2 == 0)
+            y = -y;
+        big_integer a = big_integer(std::to_string(x)), b = big_integer(std::to_string(y));
+        EXPECT_EQ(a & b, big_integer(std::to_string(x & y)));
+        EXPECT_EQ(a | b, big_integer(std::to_string(x | y)));
+        EXPECT_EQ(a ^ b, big_integer(std::to_string(x ^ y)));
+        EXPECT_EQ(~a, big_integer(std::to_string(~x)));
+    }
+
+    // the magnitude of a negative result can need a limb more than either operand
+    big_integer a = -(big_integer(1) << 32);
+    big_integer b("-18446744069414584321");
+    EXPECT_EQ(a & b, -(big_integer(1) << 64));
+
+    big_integer c = (big_integer(1) << 200) / 3;
+    big_integer d = -(big_integer(1) << 150) / 7;
+    EXPECT_EQ((c & d) + (c | d), c + d);
+    EXPECT_EQ(c ^ d, (c | d) - (c & d));
+    c &= c;
+    EXPECT_EQ(c, (big_integer(1) << 200) / 3);
+}
+
+TEST(correctness, shl_zero)
+{
+    for (int shift : {32, 64, 1000})
+    {
+        big_integer a = big_integer(0) << shift;
+        EXPECT_EQ(a, 0);
+        EXPECT_EQ(to_string(a), "0");
+        a <<= shift;
+        EXPECT_EQ(a + 1, 1);
+    }
+}
+
 TEST(correctness, shl_)
 {
     big_integer a = 23;
@@ -598,6 +666,21 @@ TEST(correctness, shr_long)
 
 }
 
+TEST(correctness, limb_count_boundaries)
+{
+    for (int k = 0; k != 20; ++k)
+    {
+        big_integer a = (big_integer(1) << (32 * k)) - 1;
+        big_integer b = a;
+        ++b;
+        EXPECT_EQ(b >> (32 * k), 1);
+        --b;
+        EXPECT_EQ(a, b);
+        EXPECT_EQ(big_integer(to_string(a)), a);
+        EXPECT_EQ((a * a + 2 * a + 1) / (a + 1), a + 1);
+    }
+}
+
 TEST(correctness, string_conv)
 {
     EXPECT_EQ(to_string(big_integer("100")), "100");
@@ -607,6 +690,723 @@ TEST(correctness, string_conv)
     EXPECT_EQ(to_string(big_integer("-1000000000000000")), "-1000000000000000");
 }
 
+TEST(correctness, view_)
+{
+    uint32_t limbs[] = {1, 2, 3, 0};
+    big_integer_view v(limbs, 4, true);
+    big_integer a = big_integer(3) << 64;
+
+    EXPECT_EQ(v.size, 3u);
+    EXPECT_EQ(big_integer(v), -(a + (big_integer(2) << 32) + 1));
+    EXPECT_EQ(a + v, -(big_integer(2) << 32) - 1);
+    EXPECT_EQ(a - v, 2 * a + (big_integer(2) << 32) + 1);
+    EXPECT_EQ(a * v, a * big_integer(v));
+    EXPECT_EQ((a * a) / v, (a * a) / big_integer(v));
+    EXPECT_EQ((a * a) % v, (a * a) % big_integer(v));
+    EXPECT_EQ(a & v, a & big_integer(v));
+    EXPECT_EQ(a | v, a | big_integer(v));
+    EXPECT_EQ(a ^ v, a ^ big_integer(v));
+    EXPECT_TRUE(a > v);
+    EXPECT_TRUE(-a > v);
+    EXPECT_TRUE(-a * 2 < v);
+    EXPECT_TRUE(big_integer(v) == v);
+    EXPECT_EQ(to_string(v), to_string(big_integer(v)));
+    EXPECT_EQ(to_string(big_integer_view(limbs, 0, true)), "0");
+}
+
+TEST(correctness, self_arithmetic)
+{
+    big_integer a = (big_integer(1) << 100) + 5;
+    big_integer b = a;
+    a += a;
+    EXPECT_EQ(a, 2 * b);
+    a -= a;
+    EXPECT_EQ(a, 0);
+    b *= b;
+    EXPECT_EQ(b, ((big_integer(1) << 100) + 5) * ((big_integer(1) << 100) + 5));
+    b /= b;
+    EXPECT_EQ(b, 1);
+}
+
+TEST(correctness, to_chars_)
+{
+    big_integer a("-340282366920938463463374607431768211456");
+    char buf[64];
+
+    std::to_chars_result r = to_chars(buf, buf + sizeof(buf), a);
+    EXPECT_EQ(r.ec, std::errc());
+    EXPECT_EQ(std::string(buf, r.ptr), "-340282366920938463463374607431768211456");
+    EXPECT_GE(to_chars_size(a), size_t(r.ptr - buf));
+
+    r = to_chars(buf, buf + sizeof(buf), a, 16);
+    EXPECT_EQ(std::string(buf, r.ptr), "-100000000000000000000000000000000");
+    EXPECT_EQ(to_chars_size(a, 16), size_t(r.ptr - buf));
+
+    r = to_chars(buf, buf + sizeof(buf), big_integer(1295), 36);
+    EXPECT_EQ(std::string(buf, r.ptr), "zz");
+
+    r = to_chars(buf, buf + 10, a);
+    EXPECT_EQ(r.ec, std::errc::value_too_large);
+}
+
+TEST(correctness, from_chars_)
+{
+    std::string s = "-123456789012345678901234567890xyz";
+    big_integer a = 5;
+
+    std::from_chars_result r = from_chars(s.data(), s.data() + s.size(), a);
+    EXPECT_EQ(r.ec, std::errc());
+    EXPECT_EQ(r.ptr, s.data() + 31);
+    EXPECT_EQ(a, big_integer("-123456789012345678901234567890"));
+
+    s = "FFffFFffFFffFFff1";
+    r = from_chars(s.data(), s.data() + s.size(), a, 16);
+    EXPECT_EQ(a, (big_integer(1) << 68) - 15);
+
+    s = "-x";
+    r = from_chars(s.data(), s.data() + s.size(), a);
+    EXPECT_EQ(r.ec, std::errc::invalid_argument);
+    EXPECT_EQ(r.ptr, s.data());
+    EXPECT_EQ(a, (big_integer(1) << 68) - 15);
+
+    EXPECT_THROW(big_integer("12a"), std::runtime_error);
+    EXPECT_THROW(big_integer("-"), std::runtime_error);
+}
+
+TEST(correctness, stream_output)
+{
+    big_integer a = 1;
+    for (int i = 0; i != 300; ++i)
+        a *= 1000000007;
+    a = -a;
+
+    std::ostringstream out;
+    out << a << ' ' << big_integer(0) << ' ' << std::hex << big_integer(-255) << ' ' << std::oct << big_integer(8);
+    EXPECT_EQ(out.str(), to_string(a) + " 0 -ff 10");
+}
+
+TEST(correctness, stream_output_width)
+{
+    std::ostringstream out;
+    out << std::setw(6) << std::setfill('*') << big_integer(42) << '|' << big_integer(42);
+    out << '|' << std::left << std::setw(5) << big_integer(-7) << '|' << std::setw(3) << big_integer(123456);
+    out << '|' << std::right << std::hex << std::setw(4) << big_integer(255);
+    EXPECT_EQ(out.str(), "****42|42|-7***|123456|**ff");
+}
+
+TEST(correctness, stream_input)
+{
+    std::string long_value = "-" + std::string(2000, '9');
+    std::istringstream in("  42 " + long_value + " ff x");
+    big_integer a, b, c, d = 7;
+
+    in >> a >> b >> std::hex >> c;
+    EXPECT_EQ(a, 42);
+    EXPECT_EQ(to_string(b), long_value);
+    EXPECT_EQ(c, 255);
+    EXPECT_TRUE(in.good());
+
+    in >> d;
+    EXPECT_TRUE(in.fail());
+    EXPECT_EQ(d, 7);
+}
+
+TEST(correctness, serialize_)
+{
+    big_integer a("-123456789012345678901234567890123456789");
+    std::vector<uint8_t> bytes = serialize(a);
+
+    EXPECT_EQ(bytes.size(), serialized_size(a));
+    EXPECT_EQ(bytes[0], 1);
+    EXPECT_EQ(bytes[1], 1);
+    EXPECT_EQ(bytes[4], 4);
+    EXPECT_EQ(deserialize(bytes.data(), bytes.size()), a);
+    EXPECT_EQ(deserialize(serialize(big_integer()).data(), 12), 0);
+
+    std::stringstream stream;
+    serialize(stream, a);
+    serialize(stream, big_integer(7));
+    EXPECT_EQ(deserialize(stream), a);
+    EXPECT_EQ(deserialize(stream), 7);
+    EXPECT_THROW(deserialize(stream), std::runtime_error);
+
+    EXPECT_THROW(deserialize(bytes.data(), bytes.size() - 1), std::runtime_error);
+    bytes[0] = 2;
+    EXPECT_THROW(deserialize(bytes.data(), bytes.size()), std::runtime_error);
+}
+
+TEST(correctness, deserialize_huge_count)
+{
+    // a header claiming far more limbs than follow must not allocate for them or wrap the size
+    uint64_t counts[] = {0x4000000000000001ull, UINT64_MAX, 1ull << 40};
+    for (uint64_t count : counts)
+    {
+        std::string bytes(16, '\0');
+        bytes[0] = 1;
+        for (int i = 0; i != 8; ++i)
+            bytes[4 + i] = static_cast<char>(count >> (8 * i));
+        std::istringstream stream(bytes);
+        EXPECT_THROW(deserialize(stream), std::runtime_error);
+        EXPECT_THROW(deserialize(reinterpret_cast<uint8_t const *>(bytes.data()), bytes.size()), std::runtime_error);
+    }
+
+    // more limbs than one read chunk
+    big_integer a = (big_integer(1) << 3000000) - 12345;
+    std::stringstream stream;
+    serialize(stream, a);
+    EXPECT_EQ(deserialize(stream), a);
+}
+
+TEST(correctness, map_file_)
+{
+    std::string path = "big_integer_testing.tmp";
+    big_integer a = (big_integer(-12345) << 10000) + 777;
+    write_file(path, a);
+    {
+        big_integer m = map_file(path);
+        big_integer c = m;
+        EXPECT_EQ(m, a);
+
+        c += 1;
+        c *= 3;
+        EXPECT_EQ(c, (a + 1) * 3);
+        EXPECT_EQ(m, a);
+        EXPECT_EQ(m + 0, a);
+    }
+    EXPECT_EQ(map_file(path), a);
+
+    write_file(path, 5);
+    EXPECT_EQ(map_file(path), 5);
+    std::remove(path.c_str());
+    EXPECT_THROW(map_file(path), std::runtime_error);
+}
+
+TEST(correctness, import_export)
+{
+    uint8_t be[] = {0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09};
+    big_integer a = import_words(be, 9, 1, word_order::most_significant_first, byte_order::big);
+    EXPECT_EQ(a, big_integer("18591708106338011145"));
+
+    uint16_t words[] = {0x0809, 0x0607, 0x0405, 0x0203, 0x0001};
+    EXPECT_EQ(import_words(words, 5, 2, word_order::least_significant_first, byte_order::native), a);
+
+    uint8_t out[16] = {};
+    EXPECT_EQ(export_size(a, 4), 3u);
+    EXPECT_EQ(export_words(out, 4, word_order::most_significant_first, byte_order::big, -a), 3u);
+    uint8_t expected[] = {0x00, 0x00, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09};
+    EXPECT_TRUE(std::equal(expected, expected + 12, out));
+    EXPECT_EQ(export_size(big_integer(), 4), 0u);
+}
+
+TEST(correctness, twos_complement_export)
+{
+    uint8_t out[4];
+    EXPECT_TRUE(export_twos_complement(out, 4, 1, word_order::most_significant_first, byte_order::big, -2));
+    EXPECT_EQ(out[0], 0xff);
+    EXPECT_EQ(out[3], 0xfe);
+    EXPECT_EQ(import_twos_complement(out, 4, 1, word_order::most_significant_first, byte_order::big), -2);
+
+    big_integer min = -(big_integer(1) << 31);
+    EXPECT_TRUE(export_twos_complement(out, 2, 2, word_order::least_significant_first, byte_order::little, min));
+    EXPECT_EQ(import_twos_complement(out, 2, 2, word_order::least_significant_first, byte_order::little), min);
+    EXPECT_FALSE(export_twos_complement(out, 1, 4, word_order::least_significant_first, byte_order::little, min - 1));
+    EXPECT_FALSE(export_twos_complement(out, 1, 4, word_order::least_significant_first, byte_order::little, -min));
+
+    uint8_t odd[3] = {0x80, 0x00, 0x00};
+    EXPECT_EQ(import_twos_complement(odd, 3, 1, word_order::most_significant_first, byte_order::big),
+              -(big_integer(1) << 23));
+}
+
+TEST(correctness, varint_)
+{
+    uint8_t buf[256];
+
+    EXPECT_EQ(encode_varint(0, buf), 1u);
+    EXPECT_EQ(buf[0], 0);
+    EXPECT_EQ(encode_varint(-1, buf), 1u);
+    EXPECT_EQ(buf[0], 1);
+    EXPECT_EQ(encode_varint(64, buf), 2u);
+    EXPECT_EQ(buf[0], 0x80);
+    EXPECT_EQ(buf[1], 0x01);
+    EXPECT_EQ(varint_size(-64), 1u);
+    EXPECT_EQ(varint_size(-65), 2u);
+
+    std::vector<big_integer> values = {0, 1, -1, 63, -64, big_integer(1) << 32, -(big_integer(1) << 32),
+                                       big_integer("-340282366920938463463374607431768211456"),
+                                       big_integer("123456789012345678901234567890123456789012345678901234567890")};
+    size_t size = 0;
+    for (big_integer const &v : values)
+        size += encode_varint(v, buf + size);
+
+    size_t pos = 0;
+    for (big_integer const &v : values)
+    {
+        big_integer r;
+        size_t n = decode_varint(buf + pos, size - pos, r);
+        EXPECT_EQ(n, varint_size(v));
+        EXPECT_EQ(r, v);
+        pos += n;
+    }
+    EXPECT_EQ(pos, size);
+
+    big_integer r;
+    size = encode_varint(values.back(), buf);
+    EXPECT_THROW(decode_varint(buf, size - 1, r), std::runtime_error);
+}
+
+TEST(correctness, order_key_)
+{
+    std::vector<big_integer> values = {0, 1, -1, 2, -2, 255, -256, big_integer(1) << 32, -(big_integer(1) << 32),
+                                       big_integer(1) << 4000, -(big_integer(1) << 4000),
+                                       big_integer(1) << 5000, -(big_integer(1) << 5000),
+                                       (big_integer(1) << 5000) + 1, -(big_integer(1) << 5000) - 1};
+    for (int i = 0; i != 50; ++i)
+        values.push_back(big_integer(rand() - RAND_MAX / 2) * rand() * rand());
+
+    std::vector<std::string> keys;
+    for (big_integer const &v : values)
+    {
+        keys.push_back(order_key(v));
+        EXPECT_EQ(keys.back().size(), order_key_size(v));
+        EXPECT_EQ(decode_order_key(reinterpret_cast<uint8_t const *>(keys.back().data()), keys.back().size()), v);
+    }
+
+    for (size_t i = 0; i != values.size(); ++i)
+        for (size_t j = 0; j != values.size(); ++j)
+            EXPECT_EQ(values[i] < values[j], keys[i] < keys[j]);
+
+    uint8_t bad[] = {0x82, 0, 0, 0, 1};
+    EXPECT_THROW(decode_order_key(bad, sizeof(bad)), std::runtime_error);
+}
+
+TEST(correctness, capacity_)
+{
+    big_integer a;
+    a.reserve(100);
+    size_t capacity = a.capacity();
+    EXPECT_GE(capacity, 100u);
+    big_integer copy = a;
+    for (int i = 0; i != 3000; ++i)
+    {
+        a <<= 1;
+        a += 1;
+    }
+    EXPECT_EQ(a, (big_integer(1) << 3000) - 1);
+    EXPECT_EQ(a.capacity(), capacity);
+    EXPECT_EQ(copy, 0);
+
+    a >>= 2990;
+    EXPECT_EQ(a, 1023);
+    EXPECT_EQ(a.capacity(), capacity);
+    a.shrink_to_fit();
+    EXPECT_EQ(a, 1023);
+    EXPECT_LT(a.capacity(), capacity);
+
+    big_integer b = 1;
+    size_t reallocations = 0;
+    for (int i = 0; i != 10000; ++i)
+    {
+        size_t before = b.capacity();
+        b *= 3;
+        reallocations += b.capacity() != before;
+    }
+    EXPECT_LE(reallocations, 20u);
+}
+
+TEST(correctness, capacity_overflow)
+{
+    // the byte counts of these would wrap around to a few bytes
+    big_integer a = 5;
+    EXPECT_THROW(a.reserve(SIZE_MAX / 4 + 2), std::bad_alloc);
+    EXPECT_THROW(a.reserve(SIZE_MAX), std::bad_alloc);
+    EXPECT_EQ(a.capacity(), big_integer(5).capacity());
+    EXPECT_EQ(a + a, 10);
+}
+
+TEST(correctness, div_scratch)
+{
+    big_integer a = (big_integer(1) << 4000) - 3;
+    big_integer b = (big_integer(1) << 1500) + 12345;
+    big_integer q = a / b;
+    big_integer r = a % b;
+    EXPECT_EQ(q * b + r, a);
+    EXPECT_TRUE(r >= 0 && r < b);
+    EXPECT_EQ(-a % b, -r);
+    EXPECT_EQ(a % -b, r);
+    EXPECT_EQ(a % a, 0);
+    EXPECT_EQ(b % a, b);
+
+    size_t reserved = scratch_frame::reserved();
+    EXPECT_GT(reserved, 0u);
+    limb_pool::statistics before = limb_pool::stats();
+    for (int i = 0; i != 100; ++i)
+    {
+        EXPECT_EQ(a / b, q);
+        EXPECT_EQ(a % b, r);
+    }
+    EXPECT_EQ(limb_pool::stats().misses, before.misses);
+    EXPECT_EQ(scratch_frame::reserved(), reserved);
+
+    scratch_frame::trim();
+    EXPECT_EQ(scratch_frame::reserved(), 0u);
+}
+
+TEST(correctness, huge_pages)
+{
+    size_t threshold = huge_page_resource::threshold();
+    huge_page_resource::set_threshold(16 * 1024);
+
+    big_integer a = (big_integer(1) << 150000) - 1;
+    EXPECT_EQ(a.capacity() % (huge_page_resource::page_size / sizeof(uint32_t)),
+              huge_page_resource::page_size / sizeof(uint32_t) - 16);
+    big_integer b = a * a;
+    EXPECT_EQ(b, (big_integer(1) << 300000) - (big_integer(1) << 150001) + 1);
+    EXPECT_EQ(b / a, a);
+    EXPECT_EQ(b % (a + 2), 4);
+
+    huge_page_resource::set_threshold(threshold);
+    big_integer c = a;
+    c.shrink_to_fit();
+    EXPECT_EQ(c, a);
+}
+
+TEST(correctness, memory_budget_)
+{
+    big_integer a = big_integer(1) << 1000;
+    memory_budget::set_thread_limit(64 * 1024);
+    EXPECT_THROW(a <<= 1000000, budget_exceeded);
+    EXPECT_EQ(a, big_integer(1) << 1000);
+    EXPECT_THROW(big_integer(std::string(200000, '9')), std::bad_alloc);
+    big_integer b = a * a + 1;
+    EXPECT_EQ(b % a, 1);
+    EXPECT_GT(memory_budget::thread_usage(), 0);
+    memory_budget::set_thread_limit(0);
+
+    size_t used = memory_budget::global_usage();
+    memory_budget::set_global_limit(used + 64 * 1024);
+    EXPECT_THROW(a << 1000000, budget_exceeded);
+    {
+        big_integer c = a * b;
+        EXPECT_GT(memory_budget::global_usage(), used);
+    }
+    EXPECT_EQ(memory_budget::global_usage(), used);
+    memory_budget::set_global_limit(0);
+    EXPECT_EQ(a << 1000000 >> 1000000, a);
+}
+
+TEST(correctness, limb_span_)
+{
+    smart_vector a(20);
+    a[3] = 7;
+    smart_vector b = a;
+    limb_span s = b.span();
+    EXPECT_EQ(s.size, 20u);
+    s.data[3] = 9;
+    s.data[19] = 1;
+    EXPECT_EQ(a[3], 7u);
+    EXPECT_EQ(a.span().data[19], 0u);
+    const_limb_span c = static_cast<smart_vector const &>(b).span();
+    EXPECT_EQ(c.data, s.data);
+    EXPECT_EQ(c.data[3], 9u);
+
+    EXPECT_EQ(-(big_integer(1) << 32) >> 32, -1);
+    EXPECT_EQ(-(big_integer(1) << 64) >> 64, -1);
+    EXPECT_EQ((-(big_integer(1) << 64) - 1) >> 64, -2);
+}
+
+TEST(correctness, mpn_)
+{
+    uint32_t a[] = {UINT32_MAX, UINT32_MAX, 5};
+    uint32_t b[] = {1, 0, 0};
+    uint32_t r[6];
+    EXPECT_EQ(mpn::add_n(r, a, b, 3), 0u);
+    EXPECT_EQ(r[0], 0u);
+    EXPECT_EQ(r[1], 0u);
+    EXPECT_EQ(r[2], 6u);
+    EXPECT_EQ(mpn::sub_n(r, b, a, 3), 1u);
+    EXPECT_EQ(mpn::add_1(r, a, 2, 1), 1u);
+    EXPECT_EQ(mpn::sub_1(r, b, 3, 2), 1u);
+    EXPECT_EQ(mpn::cmp(a, b, 3), 1);
+
+    EXPECT_EQ(mpn::mul_1(r, a, 3, 2), 0u);
+    EXPECT_EQ(r[0], UINT32_MAX - 1);
+    EXPECT_EQ(r[2], 11u);
+    EXPECT_EQ(mpn::submul_1(r, a, 3, 2), 0u);
+    EXPECT_EQ(mpn::cmp(r, b, 1), -1);
+    EXPECT_EQ(mpn::addmul_1(r, a, 3, 1), 0u);
+    EXPECT_EQ(mpn::cmp(r, a, 3), 0);
+
+    EXPECT_EQ(mpn::lshift(r, a, 3, 4), 0u);
+    EXPECT_EQ(mpn::rshift(r, r, 3, 4), 0u);
+    EXPECT_EQ(mpn::cmp(r, a, 3), 0);
+    EXPECT_EQ(mpn::rshift(r, a, 3, 1), 0x80000000u);
+
+    uint32_t q[3];
+    EXPECT_EQ(mpn::divrem_1(q, a, 3, 7), mpn::mod_1(a, 3, 7));
+    EXPECT_EQ(mpn::mul_1(r, q, 3, 7) + mpn::add_1(r, r, 3, mpn::mod_1(a, 3, 7)), 0u);
+    EXPECT_EQ(mpn::cmp(r, a, 3), 0);
+
+    mpn::mul_basecase(r, a, 3, a, 3);
+    EXPECT_EQ(big_integer(big_integer_view(r, 6)), big_integer(big_integer_view(a, 3)) * big_integer(big_integer_view(a, 3)));
+    uint32_t d[] = {3, 1};
+    uint32_t quot[5];
+    uint32_t rem[2];
+    mpn::tdiv_qr(quot, rem, r, 6, d, 2);
+    big_integer n(big_integer_view(r, 6));
+    big_integer dv(big_integer_view(d, 2));
+    EXPECT_EQ(big_integer(big_integer_view(quot, 5)), n / dv);
+    EXPECT_EQ(big_integer(big_integer_view(rem, 2)), n % dv);
+}
+
+TEST(correctness, mpn_kernels_agree)
+{
+    for (int iteration = 0; iteration != 200; ++iteration)
+    {
+        size_t an = rand() % 40 + 1;
+        size_t bn = rand() % 40 + 1;
+        std::vector<uint32_t> a(an), b(bn);
+        for (uint32_t &x : a)
+            x = rand() % 3 == 0 ? UINT32_MAX : static_cast<uint32_t>(rand()) * 2654435761u;
+        for (uint32_t &x : b)
+            x = rand() % 3 == 0 ? UINT32_MAX : static_cast<uint32_t>(rand()) * 2246822519u;
+        uint32_t m = static_cast<uint32_t>(rand()) * 3266489917u;
+        size_t n = std::min(an, bn);
+
+        std::vector<uint32_t> results[2];
+        for (int portable = 0; portable != 2; ++portable)
+        {
+            mpn::force_portable(portable == 1);
+            std::vector<uint32_t> &out = results[portable];
+            std::vector<uint32_t> r(an + bn);
+            out.push_back(mpn::add_n(r.data(), a.data(), b.data(), n));
+            out.insert(out.end(), r.begin(), r.begin() + n);
+            out.push_back(mpn::sub_n(r.data(), a.data(), b.data(), n));
+            out.insert(out.end(), r.begin(), r.begin() + n);
+            out.push_back(mpn::mul_1(r.data(), a.data(), an, m));
+            out.insert(out.end(), r.begin(), r.begin() + an);
+            std::copy(b.begin(), b.begin() + n, r.begin());
+            out.push_back(mpn::addmul_1(r.data(), a.data(), n, m));
+            out.push_back(mpn::submul_1(r.data(), b.data(), n, m));
+            out.insert(out.end(), r.begin(), r.begin() + n);
+            mpn::mul_basecase(r.data(), a.data(), an, b.data(), bn);
+            out.insert(out.end(), r.begin(), r.end());
+        }
+        mpn::force_portable(false);
+        EXPECT_EQ(results[0], results[1]);
+    }
+}
+
+TEST(correctness, mpn_vector_add)
+{
+    // long runs of all-ones and zero limbs make carries ripple across many lanes
+    for (int iteration = 0; iteration != 300; ++iteration)
+    {
+        size_t n = rand() % 100;
+        std::vector<uint32_t> a(n), b(n);
+        for (size_t i = 0; i != n; ++i)
+        {
+            int kind = rand() % 4;
+            a[i] = kind == 0 ? UINT32_MAX : kind == 1 ? 0 : static_cast<uint32_t>(rand()) * 2654435761u;
+            b[i] = kind == 0 ? 0 : kind == 1 ? UINT32_MAX : static_cast<uint32_t>(rand()) * 2246822519u;
+            if (rand() % 8 == 0)
+                b[i] = 1;
+        }
+        std::vector<uint32_t> expected(n), r(n);
+        mpn::force_portable(true);
+        uint32_t carry = mpn::add_n(expected.data(), a.data(), b.data(), n);
+        mpn::force_portable(false);
+        EXPECT_EQ(mpn::add_n(r.data(), a.data(), b.data(), n), carry);
+        EXPECT_EQ(r, expected);
+
+        mpn::force_portable(true);
+        uint32_t borrow = mpn::sub_n(expected.data(), a.data(), b.data(), n);
+        mpn::force_portable(false);
+        EXPECT_EQ(mpn::sub_n(r.data(), a.data(), b.data(), n), borrow);
+        EXPECT_EQ(r, expected);
+#ifdef MPN_X86_64
+        if (mpn::has_avx2())
+        {
+            EXPECT_EQ(mpn::avx2_sub_n(r.data(), a.data(), b.data(), n), borrow);
+            EXPECT_EQ(r, expected);
+            mpn::force_portable(true);
+            mpn::add_n(expected.data(), a.data(), b.data(), n);
+            mpn::force_portable(false);
+            EXPECT_EQ(mpn::avx2_add_n(r.data(), a.data(), b.data(), n), carry);
+            EXPECT_EQ(r, expected);
+        }
+#endif
+    }
+}
+
+TEST(correctness, mpn_mul_kernels)
+{
+    for (int iteration = 0; iteration != 60; ++iteration)
+    {
+        size_t an = rand() % 150 + 1;
+        size_t bn = rand() % 150 + 1;
+        std::vector<uint32_t> a(an), b(bn);
+        for (uint32_t &x : a)
+            x = rand() % 4 == 0 ? UINT32_MAX : static_cast<uint32_t>(rand()) * 2654435761u;
+        for (uint32_t &x : b)
+            x = rand() % 4 == 0 ? UINT32_MAX : static_cast<uint32_t>(rand()) * 2246822519u;
+
+        std::vector<uint32_t> product(an + bn), square(2 * an), r(an + bn), r2(2 * an);
+        mpn::force_portable(true);
+        mpn::mul_basecase(product.data(), a.data(), an, b.data(), bn);
+        mpn::sqr_basecase(square.data(), a.data(), an);
+        mpn::force_portable(false);
+        mpn::mul_basecase(r.data(), a.data(), an, b.data(), bn);
+        mpn::sqr_basecase(r2.data(), a.data(), an);
+        EXPECT_EQ(r, product);
+        EXPECT_EQ(r2, square);
+        mpn::mul_basecase(r2.data(), a.data(), an, a.data(), an);
+        EXPECT_EQ(r2, square);
+#ifdef MPN_X86_64
+        if (mpn::has_avx512_ifma())
+        {
+            mpn::ifma_mul_basecase(r.data(), a.data(), an, b.data(), bn);
+            EXPECT_EQ(r, product);
+            mpn::ifma_sqr_basecase(r2.data(), a.data(), an);
+            EXPECT_EQ(r2, square);
+        }
+#endif
+    }
+
+    big_integer x = (big_integer(1) << 5000) - 1;
+    EXPECT_EQ(x * x, (big_integer(1) << 10000) - (big_integer(1) << 5001) + 1);
+}
+
+TEST(correctness, mpn_basecase_rows)
+{
+    // row counts around the groups of four and a b long enough to be split into L1 blocks
+    size_t lengths[][2] = {{1, 7}, {4, 4}, {5, 3}, {6, 9}, {9, 1}, {13, 40}, {37, 5000}, {3, 4097}};
+    // the portable rows and, where the machine has them, the ADX ones
+    for (int portable = 1; portable >= 0; --portable)
+    {
+        mpn::force_portable(portable == 1);
+        for (auto const &length : lengths)
+        {
+            size_t an = length[0], bn = length[1];
+            std::vector<uint32_t> a(an), b(bn);
+            for (uint32_t &x : a)
+                x = rand() % 3 == 0 ? UINT32_MAX : static_cast<uint32_t>(rand()) * 2654435761u;
+            for (uint32_t &x : b)
+                x = rand() % 3 == 0 ? UINT32_MAX : static_cast<uint32_t>(rand()) * 2246822519u;
+
+            std::vector<uint32_t> expected(an + bn), r(an + bn);
+            for (size_t i = 0; i != an; ++i)
+                expected[i + bn] = mpn::addmul_1(expected.data() + i, b.data(), bn, a[i]);
+            mpn::mul_basecase(r.data(), a.data(), an, b.data(), bn);
+            EXPECT_EQ(r, expected);
+
+            std::vector<uint32_t> square(2 * bn), r2(2 * bn);
+            for (size_t i = 0; i != bn; ++i)
+                square[i + bn] = mpn::addmul_1(square.data() + i, b.data(), bn, b[i]);
+            mpn::sqr_basecase(r2.data(), b.data(), bn);
+            EXPECT_EQ(r2, square);
+        }
+    }
+    mpn::force_portable(false);
+}
+
+TEST(correctness, mpn_small_kernels)
+{
+    for (int iteration = 0; iteration != 200; ++iteration)
+    {
+        size_t n = iteration % 7 + 2;
+        size_t dn = rand() % (n - 1) + 2;
+        uint32_t a[8], b[8];
+        for (size_t i = 0; i != n; ++i)
+        {
+            a[i] = rand() % 4 == 0 ? UINT32_MAX : static_cast<uint32_t>(rand()) * 2654435761u;
+            b[i] = rand() % 4 == 0 ? UINT32_MAX : static_cast<uint32_t>(rand()) * 2246822519u;
+        }
+        b[dn - 1] |= rand() % 2 == 0 ? 1 : 0x80000000u;
+
+        uint32_t r[16], expected[16], q[8], rest[8], expected_q[8], expected_rest[8];
+        mpn::small_switch(n, [&](auto size) {
+            constexpr size_t N = decltype(size)::value;
+            EXPECT_EQ(mpn::add_n<N>(r, a, b), mpn::add_n(expected, a, b, N));
+            EXPECT_TRUE(std::equal(r, r + N, expected));
+            EXPECT_EQ(mpn::sub_n<N>(r, a, b), mpn::sub_n(expected, a, b, N));
+            EXPECT_TRUE(std::equal(r, r + N, expected));
+            mpn::mul_n<N>(r, a, b);
+            mpn::mul_basecase(expected, a, N, b, N);
+            EXPECT_TRUE(std::equal(r, r + 2 * N, expected));
+            mpn::sqr_n<N>(r, a);
+            mpn::sqr_basecase(expected, a, N);
+            EXPECT_TRUE(std::equal(r, r + 2 * N, expected));
+            mpn::divrem_n<N>(q, rest, a, b, dn);
+            mpn::tdiv_qr(expected_q, expected_rest, a, N, b, dn);
+            EXPECT_TRUE(std::equal(q, q + N - dn + 1, expected_q));
+            EXPECT_TRUE(std::equal(rest, rest + dn, expected_rest));
+            return 0;
+        });
+    }
+
+    // the operators pad the shorter operand for the kernels
+    big_integer x("-123456789012345678901234567890123456789");
+    big_integer y("98765432109876543210");
+    EXPECT_EQ(x + y, big_integer("-123456789012345678802469135780246913579"));
+    EXPECT_EQ(y - x, big_integer("123456789012345678999999999999999999999"));
+    EXPECT_EQ(x * y, big_integer("-12193263113702179522496570642249657064223746380111126352690"));
+    EXPECT_EQ(x * x, big_integer("15241578753238836750495351562566681945005334557625361987875019051998750190521"));
+    EXPECT_EQ(x / y, big_integer("-1249999988609375000"));
+    EXPECT_EQ(x % y, x - x / y * y);
+}
+
+TEST(correctness, limb_pool_)
+{
+    limb_pool::trim();
+    EXPECT_EQ(limb_pool::stats().cached_blocks, 0u);
+    EXPECT_EQ(limb_pool::round_up(100), limb_pool::min_pooled);
+    EXPECT_EQ(limb_pool::round_up(limb_pool::max_pooled + 1), limb_pool::max_pooled + limb_pool::alignment);
+
+    big_integer a = big_integer(1) << 3000;
+    limb_pool::statistics before = limb_pool::stats();
+    for (int i = 0; i != 100; ++i)
+    {
+        big_integer b = a + i;
+        EXPECT_EQ(b - a, i);
+    }
+    limb_pool::statistics after = limb_pool::stats();
+    EXPECT_GE(after.hits - before.hits, 100u);
+    EXPECT_LE(after.misses - before.misses, 2u);
+    EXPECT_GT(after.cached_bytes, 0u);
+
+    limb_pool::trim();
+    EXPECT_EQ(limb_pool::stats().cached_blocks, 0u);
+    EXPECT_EQ(limb_pool::stats().cached_bytes, 0u);
+}
+
+TEST(correctness, memory_resource_)
+{
+    big_integer a = (big_integer(1) << 5000) - 12345;
+    big_integer b = (big_integer(1) << 3000) + 777;
+    big_integer expected = a * b / (b - 1) % a;
+
+    std::vector<unsigned char> buffer(1 << 20);
+    std::pmr::monotonic_buffer_resource arena(buffer.data(), buffer.size(), std::pmr::null_memory_resource());
+    limb_pool::statistics before = limb_pool::stats();
+    scratch_frame::trim();
+    size_t scratch = scratch_frame::reserved();
+    {
+        limb_resource_scope scope(&arena);
+        big_integer r = a * b / (b - 1) % a;
+        EXPECT_EQ(to_string(r), to_string(expected));
+        // the temporaries of the division and the conversion came from the arena too
+        EXPECT_EQ(scratch_frame::reserved(), scratch);
+        {
+            limb_resource_scope inner(nullptr);
+            big_integer c = a + 1;
+        }
+        EXPECT_EQ(r, expected);
+        EXPECT_EQ(r + (big_integer(1) << 4000), expected + (big_integer(1) << 4000));
+    }
+    limb_pool::statistics after = limb_pool::stats();
+    EXPECT_EQ(after.hits + after.misses, before.hits + before.misses + 1);
+}
+
 
 namespace
 {
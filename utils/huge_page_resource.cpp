@@ -0,0 +1,73 @@
+#include <atomic>
+#include <new>
+#include "huge_page_resource.h"
+
+std::atomic<size_t> mapping_threshold(size_t(8) << 20);
+
+huge_page_resource *huge_page_resource::instance() {
+    static huge_page_resource resource;
+    return &resource;
+}
+
+void huge_page_resource::set_threshold(size_t bytes) {
+    mapping_threshold.store(bytes, std::memory_order_relaxed);
+}
+
+size_t huge_page_resource::threshold() {
+    return mapping_threshold.load(std::memory_order_relaxed);
+}
+
+bool huge_page_resource::is_used_for(size_t bytes) {
+    size_t limit = threshold();
+    return limit != 0 && bytes >= limit;
+}
+
+size_t huge_page_resource::round_up(size_t bytes) {
+    return (bytes + page_size - 1) / page_size * page_size;
+}
+
+bool huge_page_resource::do_is_equal(std::pmr::memory_resource const &other) const noexcept {
+    return this == &other;
+}
+
+#ifdef _WIN32
+
+void *huge_page_resource::do_allocate(size_t bytes, size_t alignment) {
+    return ::operator new(round_up(bytes), std::align_val_t(alignment));
+}
+
+void huge_page_resource::do_deallocate(void *p, size_t, size_t alignment) {
+    ::operator delete(p, std::align_val_t(alignment));
+}
+
+#else
+
+#include <cstdint>
+#include <sys/mman.h>
+
+// maps one extra huge page and cuts the ends, so the block starts on a huge page boundary
+void *huge_page_resource::do_allocate(size_t bytes, size_t) {
+    size_t size = round_up(bytes);
+    void *raw = mmap(nullptr, size + page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) {
+        throw std::bad_alloc();
+    }
+    uintptr_t begin = reinterpret_cast<uintptr_t>(raw);
+    uintptr_t aligned = (begin + page_size - 1) / page_size * page_size;
+    if (aligned != begin) {
+        munmap(raw, aligned - begin);
+    }
+    if (aligned + size != begin + size + page_size) {
+        munmap(reinterpret_cast<void *>(aligned + size), begin + page_size - aligned);
+    }
+#ifdef MADV_HUGEPAGE
+    madvise(reinterpret_cast<void *>(aligned), size, MADV_HUGEPAGE);
+#endif
+    return reinterpret_cast<void *>(aligned);
+}
+
+void huge_page_resource::do_deallocate(void *p, size_t bytes, size_t) {
+    munmap(p, round_up(bytes));
+}
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef HUGE_PAGE_RESOURCE_H
+#define HUGE_PAGE_RESOURCE_H
+
+#include <cstddef>
+#include <memory_resource>
+
+// anonymous mappings aligned to and advised for transparent huge pages, so multi-megabyte
+// limb arrays don't fault and miss the TLB page by page. Sizes are rounded to whole huge pages.
+// Where mmap isn't available it falls back to the aligned global heap
+struct huge_page_resource : std::pmr::memory_resource {
+    static constexpr size_t page_size = size_t(2) << 20;
+
+    static huge_page_resource *instance();
+
+    // limb blocks and scratch chunks of at least this many bytes are mapped, 0 turns it off
+    static void set_threshold(size_t bytes);
+
+    static size_t threshold();
+
+    static bool is_used_for(size_t bytes);
+
+    static size_t round_up(size_t bytes);
+
+private:
+    void *do_allocate(size_t bytes, size_t alignment) override;
+
+    void do_deallocate(void *p, size_t bytes, size_t alignment) override;
+
+    bool do_is_equal(std::pmr::memory_resource const &other) const noexcept override;
+};
+
+#endif //HUGE_PAGE_RESOURCE_H
@@ -0,0 +1,113 @@
+#include <new>
+#include "limb_pool.h"
+
+const size_t MIN_CLASS_SHIFT = 7;
+const size_t MAX_CLASS_SHIFT = 20;
+const size_t CLASS_COUNT = MAX_CLASS_SHIFT - MIN_CLASS_SHIFT + 1;
+
+// every class may keep this many bytes per thread, but at least two blocks
+const size_t CACHE_BYTES_PER_CLASS = 256 * 1024;
+
+static_assert(limb_pool::min_pooled == size_t(1) << MIN_CLASS_SHIFT, "size classes mismatch");
+static_assert(limb_pool::max_pooled == size_t(1) << MAX_CLASS_SHIFT, "size classes mismatch");
+
+struct free_block {
+    free_block *next;
+};
+
+// trivially destructible, so it stays usable while other thread_local and static
+// objects are destroyed; the guard below empties it and closes it at thread exit
+struct thread_cache {
+    free_block *head[CLASS_COUNT];
+    size_t count[CLASS_COUNT];
+    size_t hits;
+    size_t misses;
+    bool closed;
+};
+
+thread_local thread_cache cache;
+
+void release_cached() {
+    for (size_t i = 0; i < CLASS_COUNT; ++i) {
+        while (cache.head[i] != nullptr) {
+            free_block *b = cache.head[i];
+            cache.head[i] = b->next;
+            ::operator delete(b, std::align_val_t(limb_pool::alignment));
+        }
+        cache.count[i] = 0;
+    }
+}
+
+struct cache_guard {
+    bool armed = false;
+
+    ~cache_guard() {
+        release_cached();
+        cache.closed = true;
+    }
+};
+
+thread_local cache_guard guard;
+
+size_t class_of(size_t bytes) {
+    size_t shift = MIN_CLASS_SHIFT;
+    while ((size_t(1) << shift) < bytes) {
+        ++shift;
+    }
+    return shift - MIN_CLASS_SHIFT;
+}
+
+size_t class_limit(size_t cls) {
+    size_t blocks = CACHE_BYTES_PER_CLASS >> (cls + MIN_CLASS_SHIFT);
+    return blocks < 2 ? 2 : blocks;
+}
+
+size_t limb_pool::round_up(size_t bytes) {
+    if (bytes <= max_pooled) {
+        return min_pooled << class_of(bytes);
+    }
+    return (bytes + alignment - 1) / alignment * alignment;
+}
+
+void *limb_pool::allocate(size_t bytes) {
+    if (bytes <= max_pooled) {
+        size_t cls = class_of(bytes);
+        free_block *b = cache.head[cls];
+        if (b != nullptr) {
+            cache.head[cls] = b->next;
+            --cache.count[cls];
+            ++cache.hits;
+            return b;
+        }
+    }
+    ++cache.misses;
+    return ::operator new(round_up(bytes), std::align_val_t(alignment));
+}
+
+void limb_pool::deallocate(void *block, size_t bytes) {
+    if (bytes <= max_pooled && !cache.closed) {
+        size_t cls = class_of(bytes);
+        if (cache.count[cls] < class_limit(cls)) {
+            guard.armed = true;
+            free_block *b = static_cast<free_block *>(block);
+            b->next = cache.head[cls];
+            cache.head[cls] = b;
+            ++cache.count[cls];
+            return;
+        }
+    }
+    ::operator delete(block, std::align_val_t(alignment));
+}
+
+limb_pool::statistics limb_pool::stats() {
+    statistics r = {cache.hits, cache.misses, 0, 0};
+    for (size_t i = 0; i < CLASS_COUNT; ++i) {
+        r.cached_blocks += cache.count[i];
+        r.cached_bytes += cache.count[i] * (min_pooled << i);
+    }
+    return r;
+}
+
+void limb_pool::trim() {
+    release_cached();
+}
@@ -0,0 +1,38 @@
+#ifndef LIMB_POOL_H
+#define LIMB_POOL_H
+
+#include <cstddef>
+
+// recycles the 64-byte aligned blocks behind smart_data. Requests up to max_pooled bytes
+// are rounded to power-of-two size classes and freed blocks are kept in per-thread free lists,
+// so steady-state arithmetic doesn't reach the global heap. Larger requests go straight to it
+struct limb_pool {
+    static constexpr size_t alignment = 64;
+
+    static constexpr size_t min_pooled = 128;
+
+    static constexpr size_t max_pooled = size_t(1) << 20;
+
+    // counters of the calling thread
+    struct statistics {
+        size_t hits;
+        size_t misses;
+        size_t cached_blocks;
+        size_t cached_bytes;
+    };
+
+    // the size a request of bytes really gets, callers may use all of it
+    static size_t round_up(size_t bytes);
+
+    static void *allocate(size_t bytes);
+
+    // bytes is the size passed to allocate or the size round_up returned for it
+    static void deallocate(void *block, size_t bytes);
+
+    static statistics stats();
+
+    // returns the blocks cached by the calling thread to the heap
+    static void trim();
+};
+
+#endif //LIMB_POOL_H
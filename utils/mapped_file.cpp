@@ -0,0 +1,74 @@
+#include <stdexcept>
+#include "mapped_file.h"
+
+#ifdef _WIN32
+
+#include <fstream>
+
+mapped_file::mapped_file(std::string const &path) : begin(nullptr), length(0) {
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in) {
+        throw std::runtime_error("can't open " + path);
+    }
+    length = static_cast<size_t>(in.tellg());
+    uint8_t *buf = new uint8_t[length];
+    in.seekg(0);
+    if (!in.read(reinterpret_cast<char *>(buf), length)) {
+        delete[] buf;
+        throw std::runtime_error("can't read " + path);
+    }
+    begin = buf;
+}
+
+mapped_file::~mapped_file() {
+    delete[] begin;
+}
+
+#else
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+mapped_file::mapped_file(std::string const &path) : begin(nullptr), length(0) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("can't open " + path);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        throw std::runtime_error("can't stat " + path);
+    }
+    length = static_cast<size_t>(st.st_size);
+    if (length != 0) {
+        void *p = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) {
+            close(fd);
+            throw std::runtime_error("can't map " + path);
+        }
+        begin = static_cast<const uint8_t *>(p);
+    }
+    close(fd);
+}
+
+mapped_file::~mapped_file() {
+    if (length != 0) {
+        munmap(const_cast<uint8_t *>(begin), length);
+    }
+}
+
+#endif
+
+const uint8_t *mapped_file::data() const {
+    return begin;
+}
+
+size_t mapped_file::size() const {
+    return length;
+}
+
+void mapped_file::release(void *context) {
+    delete static_cast<mapped_file *>(context);
+}
@@ -0,0 +1,31 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// read-only contents of a whole file, mmap-ed where the platform has it
+struct mapped_file {
+    // throws std::runtime_error if the file can't be opened or mapped
+    explicit mapped_file(std::string const &path);
+
+    mapped_file(mapped_file const &other) = delete;
+
+    mapped_file &operator=(mapped_file const &other) = delete;
+
+    ~mapped_file();
+
+    const uint8_t *data() const;
+
+    size_t size() const;
+
+    // release callback for smart_vector, the context is a heap-allocated mapped_file
+    static void release(void *context);
+
+private:
+    const uint8_t *begin;
+    size_t length;
+};
+
+#endif //MAPPED_FILE_H
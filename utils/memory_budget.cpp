@@ -0,0 +1,72 @@
+#include <atomic>
+#include "memory_budget.h"
+
+std::atomic<size_t> global_limit_bytes(0);
+std::atomic<size_t> global_used_bytes(0);
+
+thread_local size_t thread_limit_bytes = 0;
+thread_local ptrdiff_t thread_used_bytes = 0;
+
+budget_exceeded::budget_exceeded(size_t requested, size_t limit) :
+        requested(requested), limit(limit) {}
+
+const char *budget_exceeded::what() const noexcept {
+    return "big_integer memory budget exceeded";
+}
+
+void memory_budget::set_global_limit(size_t bytes) {
+    global_limit_bytes.store(bytes, std::memory_order_relaxed);
+}
+
+size_t memory_budget::global_limit() {
+    return global_limit_bytes.load(std::memory_order_relaxed);
+}
+
+size_t memory_budget::global_usage() {
+    return global_used_bytes.load(std::memory_order_relaxed);
+}
+
+void memory_budget::set_thread_limit(size_t bytes) {
+    thread_limit_bytes = bytes;
+}
+
+size_t memory_budget::thread_limit() {
+    return thread_limit_bytes;
+}
+
+ptrdiff_t memory_budget::thread_usage() {
+    return thread_used_bytes;
+}
+
+// the thread budget is checked first, so a rejected request never touches the shared counter
+unsigned memory_budget::charge(size_t bytes) {
+    unsigned charged = 0;
+    if (thread_limit_bytes != 0) {
+        if (thread_used_bytes + static_cast<ptrdiff_t>(bytes) > static_cast<ptrdiff_t>(thread_limit_bytes)) {
+            throw budget_exceeded(bytes, thread_limit_bytes);
+        }
+        charged |= thread;
+    }
+    size_t limit = global_limit_bytes.load(std::memory_order_relaxed);
+    if (limit != 0) {
+        size_t used = global_used_bytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+        if (used > limit) {
+            global_used_bytes.fetch_sub(bytes, std::memory_order_relaxed);
+            throw budget_exceeded(bytes, limit);
+        }
+        charged |= global;
+    }
+    if ((charged & thread) != 0) {
+        thread_used_bytes += bytes;
+    }
+    return charged;
+}
+
+void memory_budget::release(size_t bytes, unsigned charged) {
+    if ((charged & thread) != 0) {
+        thread_used_bytes -= bytes;
+    }
+    if ((charged & global) != 0) {
+        global_used_bytes.fetch_sub(bytes, std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,44 @@
+#ifndef MEMORY_BUDGET_H
+#define MEMORY_BUDGET_H
+
+#include <cstddef>
+#include <new>
+
+// thrown instead of allocating limb storage that would go over a memory budget
+struct budget_exceeded : std::bad_alloc {
+    size_t requested;
+    size_t limit;
+
+    budget_exceeded(size_t requested, size_t limit);
+
+    const char *what() const noexcept override;
+};
+
+// byte limits on live limb storage, checked before every smart_data allocation. The global
+// limit counts the blocks of all threads, the thread limit those of the calling thread;
+// a block freed on another thread is credited to that one. 0 means no limit, and blocks
+// allocated while a limit is off are never counted against it
+struct memory_budget {
+    static const unsigned global = 1;
+    static const unsigned thread = 2;
+
+    static void set_global_limit(size_t bytes);
+
+    static size_t global_limit();
+
+    static size_t global_usage();
+
+    static void set_thread_limit(size_t bytes);
+
+    static size_t thread_limit();
+
+    static ptrdiff_t thread_usage();
+
+    // throws budget_exceeded if bytes more would go over a limit, otherwise returns the
+    // budgets they were counted against, to be passed back to release
+    static unsigned charge(size_t bytes);
+
+    static void release(size_t bytes, unsigned charged);
+};
+
+#endif //MEMORY_BUDGET_H
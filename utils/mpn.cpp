@@ -0,0 +1,422 @@
+#include "mpn.h"
+#include "mpn_x86_64.h"
+#include "scratch_arena.h"
+
+// read before they are initialised, e.g. by another static initialiser, they are false and the portable kernels run
+#ifdef MPN_X86_64
+bool use_adx = mpn::has_adx_bmi2();
+bool use_avx2 = mpn::has_avx2();
+bool use_avx512 = mpn::has_avx512();
+bool use_ifma = mpn::has_avx512_ifma();
+#endif
+
+// below this many limbs the vector add and subtract don't pay for their setup
+const size_t VECTOR_ADD_MIN = 16;
+
+// below this many limbs in the shorter operand the radix conversion costs more than IFMA saves
+const size_t IFMA_MUL_MIN = 48;
+
+const char *mpn::kernels() {
+#ifdef MPN_X86_64
+    if (use_ifma) {
+        return use_adx ? "adx+avx512+ifma" : "avx512+ifma";
+    }
+    if (use_avx512) {
+        return use_adx ? "adx+avx512" : "avx512";
+    }
+    if (use_avx2) {
+        return use_adx ? "adx+avx2" : "avx2";
+    }
+    if (use_adx) {
+        return "adx";
+    }
+#endif
+    return "portable";
+}
+
+void mpn::force_portable(bool on) {
+#ifdef MPN_X86_64
+    use_adx = !on && has_adx_bmi2();
+    use_avx2 = !on && has_avx2();
+    use_avx512 = !on && has_avx512();
+    use_ifma = !on && has_avx512_ifma();
+#endif
+}
+
+uint32_t mpn::add_n(uint32_t *r, uint32_t const *a, uint32_t const *b, size_t n) {
+#ifdef MPN_X86_64
+    if (n >= VECTOR_ADD_MIN && use_avx512) {
+        return avx512_add_n(r, a, b, n);
+    }
+    if (n >= VECTOR_ADD_MIN && use_avx2) {
+        return avx2_add_n(r, a, b, n);
+    }
+    if (use_adx) {
+        return adx_add_n(r, a, b, n);
+    }
+#endif
+    uint64_t carry = 0;
+    for (size_t i = 0; i < n; ++i) {
+        carry += static_cast<uint64_t>(a[i]) + b[i];
+        r[i] = static_cast<uint32_t>(carry);
+        carry >>= 32;
+    }
+    return static_cast<uint32_t>(carry);
+}
+
+uint32_t mpn::sub_n(uint32_t *r, uint32_t const *a, uint32_t const *b, size_t n) {
+#ifdef MPN_X86_64
+    if (n >= VECTOR_ADD_MIN && use_avx512) {
+        return avx512_sub_n(r, a, b, n);
+    }
+    if (n >= VECTOR_ADD_MIN && use_avx2) {
+        return avx2_sub_n(r, a, b, n);
+    }
+    if (use_adx) {
+        return adx_sub_n(r, a, b, n);
+    }
+#endif
+    uint64_t borrow = 0;
+    for (size_t i = 0; i < n; ++i) {
+        uint64_t t = static_cast<uint64_t>(a[i]) - b[i] - borrow;
+        r[i] = static_cast<uint32_t>(t);
+        borrow = t >> 63;
+    }
+    return static_cast<uint32_t>(borrow);
+}
+
+// the carry stops early, the rest is only copied
+uint32_t mpn::add_1(uint32_t *r, uint32_t const *a, size_t n, uint32_t b) {
+    size_t i = 0;
+    uint32_t carry = b;
+    for (; carry != 0 && i < n; ++i) {
+        r[i] = a[i] + carry;
+        carry = r[i] < carry;
+    }
+    if (r != a) {
+        for (; i < n; ++i) {
+            r[i] = a[i];
+        }
+    }
+    return carry;
+}
+
+uint32_t mpn::sub_1(uint32_t *r, uint32_t const *a, size_t n, uint32_t b) {
+    size_t i = 0;
+    uint32_t borrow = b;
+    for (; borrow != 0 && i < n; ++i) {
+        uint32_t limb = a[i];
+        r[i] = limb - borrow;
+        borrow = limb < borrow;
+    }
+    if (r != a) {
+        for (; i < n; ++i) {
+            r[i] = a[i];
+        }
+    }
+    return borrow;
+}
+
+uint32_t mpn::add(uint32_t *r, uint32_t const *a, size_t an, uint32_t const *b, size_t bn) {
+    uint32_t carry = add_n(r, a, b, bn);
+    return add_1(r + bn, a + bn, an - bn, carry);
+}
+
+uint32_t mpn::sub(uint32_t *r, uint32_t const *a, size_t an, uint32_t const *b, size_t bn) {
+    uint32_t borrow = sub_n(r, a, b, bn);
+    return sub_1(r + bn, a + bn, an - bn, borrow);
+}
+
+uint32_t mpn::mul_1(uint32_t *r, uint32_t const *a, size_t n, uint32_t b) {
+#ifdef MPN_X86_64
+    if (use_adx) {
+        return adx_mul_1(r, a, n, b);
+    }
+#endif
+    uint64_t carry = 0;
+    for (size_t i = 0; i < n; ++i) {
+        carry += static_cast<uint64_t>(a[i]) * b;
+        r[i] = static_cast<uint32_t>(carry);
+        carry >>= 32;
+    }
+    return static_cast<uint32_t>(carry);
+}
+
+// a * b + r + carry fits in 64 bits
+uint32_t mpn::addmul_1(uint32_t *r, uint32_t const *a, size_t n, uint32_t b) {
+#ifdef MPN_X86_64
+    if (use_adx) {
+        return adx_addmul_1(r, a, n, b);
+    }
+#endif
+    uint64_t carry = 0;
+    for (size_t i = 0; i < n; ++i) {
+        carry += static_cast<uint64_t>(a[i]) * b + r[i];
+        r[i] = static_cast<uint32_t>(carry);
+        carry >>= 32;
+    }
+    return static_cast<uint32_t>(carry);
+}
+
+uint32_t mpn::submul_1(uint32_t *r, uint32_t const *a, size_t n, uint32_t b) {
+#ifdef MPN_X86_64
+    if (use_adx) {
+        return adx_submul_1(r, a, n, b);
+    }
+#endif
+    uint64_t carry = 0;
+    uint64_t borrow = 0;
+    for (size_t i = 0; i < n; ++i) {
+        uint64_t p = static_cast<uint64_t>(a[i]) * b + carry;
+        carry = p >> 32;
+        uint64_t t = static_cast<uint64_t>(r[i]) - static_cast<uint32_t>(p) - borrow;
+        r[i] = static_cast<uint32_t>(t);
+        borrow = t >> 63;
+    }
+    return static_cast<uint32_t>(carry + borrow);
+}
+
+// goes from the top, so r may lie above a
+uint32_t mpn::lshift(uint32_t *r, uint32_t const *a, size_t n, unsigned count) {
+    if (n == 0) {
+        return 0;
+    }
+    uint32_t out = a[n - 1] >> (32 - count);
+    for (size_t i = n - 1; i != 0; --i) {
+        r[i] = (a[i] << count) | (a[i - 1] >> (32 - count));
+    }
+    r[0] = a[0] << count;
+    return out;
+}
+
+uint32_t mpn::rshift(uint32_t *r, uint32_t const *a, size_t n, unsigned count) {
+    if (n == 0) {
+        return 0;
+    }
+    uint32_t out = a[0] << (32 - count);
+    for (size_t i = 0; i + 1 < n; ++i) {
+        r[i] = (a[i] >> count) | (a[i + 1] << (32 - count));
+    }
+    r[n - 1] = a[n - 1] >> count;
+    return out;
+}
+
+int mpn::cmp(uint32_t const *a, uint32_t const *b, size_t n) {
+    for (size_t i = n; i != 0; --i) {
+        if (a[i - 1] != b[i - 1]) {
+            return a[i - 1] < b[i - 1] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+uint32_t mpn::divrem_1(uint32_t *q, uint32_t const *a, size_t n, uint32_t d) {
+    uint64_t rest = 0;
+    for (size_t i = n; i != 0; --i) {
+        uint64_t cur = (rest << 32) | a[i - 1];
+        q[i - 1] = static_cast<uint32_t>(cur / d);
+        rest = cur % d;
+    }
+    return static_cast<uint32_t>(rest);
+}
+
+uint32_t mpn::mod_1(uint32_t const *a, size_t n, uint32_t d) {
+    uint64_t rest = 0;
+    for (size_t i = n; i != 0; --i) {
+        rest = ((rest << 32) | a[i - 1]) % d;
+    }
+    return static_cast<uint32_t>(rest);
+}
+
+// b chunks this long, with the window of r they touch, stay in L1 while the rows of a go over them
+const size_t MUL_BLOCK = 2048;
+
+// one column of four rows: lo + hi * 2^64 += x * y
+inline void accumulate(uint64_t &lo, uint64_t &hi, uint64_t x, uint64_t y) {
+    uint64_t p = x * y;
+    lo += p;
+    hi += lo < p;
+}
+
+// limb j of r += a[0] b[j] + a[1] b[j - 1] + a[2] b[j - 2] + a[3] b[j - 3] + carry, the four
+// products summed in 96 bits; shifts b along so the caller reads each limb of it once
+inline void column(uint32_t &r, uint64_t const *a, uint64_t *b, uint64_t b0, uint64_t &carry) {
+    uint64_t lo = carry + r;
+    uint64_t hi = 0;
+    accumulate(lo, hi, a[0], b0);
+    accumulate(lo, hi, a[1], b[0]);
+    accumulate(lo, hi, a[2], b[1]);
+    accumulate(lo, hi, a[3], b[2]);
+    r = static_cast<uint32_t>(lo);
+    carry = (lo >> 32) | (hi << 32);
+    b[2] = b[1];
+    b[1] = b[0];
+    b[0] = b0;
+}
+
+// r[0, n + 3) += b * (a[0] + a[1] B + a[2] B^2 + a[3] B^3), returns the carry limb. Each limb of r
+// takes the four products of its column at once, so r is read and written once per four rows
+uint32_t addmul_4(uint32_t *r, uint32_t const *b, size_t n, uint32_t const *a) {
+    uint64_t rows[4] = {a[0], a[1], a[2], a[3]};
+    uint64_t older[3] = {0, 0, 0};
+    uint64_t carry = 0;
+    for (size_t j = 0; j < n; ++j) {
+        column(r[j], rows, older, b[j], carry);
+    }
+    column(r[n], rows, older, 0, carry);
+    column(r[n + 1], rows, older, 0, carry);
+    column(r[n + 2], rows, older, 0, carry);
+    return static_cast<uint32_t>(carry);
+}
+
+// r = a * b, four rows at a time; the first row initialises r, so it needs no zeroing
+void mul_rows(uint32_t *r, uint32_t const *a, size_t an, uint32_t const *b, size_t bn) {
+    r[bn] = mpn::mul_1(r, b, bn, a[0]);
+    size_t i = 1;
+    for (; i + 4 <= an; i += 4) {
+        r[i + bn] = r[i + bn + 1] = r[i + bn + 2] = 0;
+        r[i + bn + 3] = addmul_4(r + i, b, bn, a + i);
+    }
+    for (; i < an; ++i) {
+        r[i + bn] = mpn::addmul_1(r + i, b, bn, a[i]);
+    }
+}
+
+// adds c at r and carries as far as needed; the caller knows the sum fits
+inline void add_at(uint32_t *r, uint64_t c) {
+    for (; c != 0; ++r) {
+        c += *r;
+        *r = static_cast<uint32_t>(c);
+        c >>= 32;
+    }
+}
+
+// the rows of a over chunks of b, each chunk's product added into r through scratch
+void mpn::mul_basecase(uint32_t *r, uint32_t const *a, size_t an, uint32_t const *b, size_t bn) {
+    void (*rows)(uint32_t *, uint32_t const *, size_t, uint32_t const *, size_t) = mul_rows;
+#ifdef MPN_X86_64
+    size_t shorter = an < bn ? an : bn;
+    if (use_ifma && shorter >= IFMA_MUL_MIN && shorter <= ifma_max_limbs) {
+        ifma_mul_basecase(r, a, an, b, bn);
+        return;
+    }
+    if (use_adx && shorter > 1) {
+        rows = adx_mul_basecase;
+    }
+#endif
+    if (bn <= MUL_BLOCK) {
+        rows(r, a, an, b, bn);
+        return;
+    }
+    rows(r, a, an, b, MUL_BLOCK);
+    scratch_frame frame;
+    uint32_t *t = frame.allocate(an + MUL_BLOCK);
+    for (size_t j = MUL_BLOCK; j < bn; j += MUL_BLOCK) {
+        size_t len = bn - j < MUL_BLOCK ? bn - j : MUL_BLOCK;
+        rows(t, a, an, b + j, len);
+        // r is written up to j + an so far
+        uint32_t carry = add_n(r + j, r + j, t, an);
+        add_1(r + j + an, t + an, len, carry);
+    }
+}
+
+// the products above the diagonal once, four rows at a time, doubled, then the squares of the limbs added
+void mpn::sqr_basecase(uint32_t *r, uint32_t const *a, size_t n) {
+#ifdef MPN_X86_64
+    if (use_ifma && n >= IFMA_MUL_MIN && n <= ifma_max_limbs) {
+        ifma_sqr_basecase(r, a, n);
+        return;
+    }
+    if (use_adx && n > 1) {
+        adx_sqr_basecase(r, a, n);
+        return;
+    }
+#endif
+    for (size_t i = 0; i < 2 * n; ++i) {
+        r[i] = 0;
+    }
+    size_t row = 0;
+    for (; row + 4 < n; row += 4) {
+        // the six products inside the group, then the group against the limbs above it
+        for (size_t k = 0; k != 3; ++k) {
+            for (size_t m = k + 1; m != 4; ++m) {
+                add_at(r + 2 * row + k + m, static_cast<uint64_t>(a[row + k]) * a[row + m]);
+            }
+        }
+        add_at(r + n + row + 3, addmul_4(r + 2 * row + 4, a + row + 4, n - row - 4, a + row));
+    }
+    for (; row + 1 < n; ++row) {
+        add_at(r + n + row, addmul_1(r + 2 * row + 1, a + row + 1, n - row - 1, a[row]));
+    }
+    lshift(r, r, 2 * n, 1);
+    uint64_t carry = 0;
+    for (size_t i = 0; i < n; ++i) {
+        uint64_t p = static_cast<uint64_t>(a[i]) * a[i];
+        carry += static_cast<uint64_t>(r[2 * i]) + static_cast<uint32_t>(p);
+        r[2 * i] = static_cast<uint32_t>(carry);
+        carry >>= 32;
+        carry += static_cast<uint64_t>(r[2 * i + 1]) + (p >> 32);
+        r[2 * i + 1] = static_cast<uint32_t>(carry);
+        carry >>= 32;
+    }
+}
+
+// Knuth's algorithm D on copies of a and d normalised in the scratch arena
+void mpn::tdiv_qr(uint32_t *q, uint32_t *r, uint32_t const *a, size_t an, uint32_t const *d, size_t dn) {
+    scratch_frame frame;
+    uint32_t *un = frame.allocate(an + 1);
+    uint32_t *vn = frame.allocate(dn);
+
+    unsigned s = 0;
+    while ((d[dn - 1] << s) < 0x80000000u) {
+        ++s;
+    }
+    if (s == 0) {
+        for (size_t i = 0; i < dn; ++i) {
+            vn[i] = d[i];
+        }
+        for (size_t i = 0; i < an; ++i) {
+            un[i] = a[i];
+        }
+        un[an] = 0;
+    } else {
+        lshift(vn, d, dn, s);
+        un[an] = lshift(un, a, an, s);
+    }
+
+    const uint64_t base = uint64_t(1) << 32;
+    uint64_t d1 = vn[dn - 1];
+    uint64_t d0 = vn[dn - 2];
+    for (size_t j = an - dn + 1; j-- != 0;) {
+        uint64_t top = (static_cast<uint64_t>(un[j + dn]) << 32) | un[j + dn - 1];
+        uint64_t qhat = top / d1;
+        uint64_t rhat = top % d1;
+        while (qhat >= base || qhat * d0 > ((rhat << 32) | un[j + dn - 2])) {
+            --qhat;
+            rhat += d1;
+            if (rhat >= base) {
+                break;
+            }
+        }
+
+        uint32_t borrow = submul_1(un + j, vn, dn, static_cast<uint32_t>(qhat));
+        uint32_t top_limb = un[j + dn];
+        un[j + dn] = top_limb - borrow;
+        if (top_limb < borrow) {
+            --qhat;
+            un[j + dn] += add_n(un + j, un + j, vn, dn);
+        }
+        q[j] = static_cast<uint32_t>(qhat);
+    }
+
+    if (r != nullptr) {
+        if (s == 0) {
+            for (size_t i = 0; i < dn; ++i) {
+                r[i] = un[i];
+            }
+        } else {
+            rshift(r, un, dn, s);
+            r[dn - 1] |= un[dn] << (32 - s);
+        }
+    }
+}
@@ -0,0 +1,71 @@
+#ifndef MPN_H
+#define MPN_H
+
+#include <cstddef>
+#include <cstdint>
+
+// low-level arithmetic on raw limb arrays, least significant limb first, that big_integer
+// is built on. Nothing here allocates except tdiv_qr, which takes its temporaries from the
+// scratch arena. Unless said otherwise, r may be the same array as an input but must not
+// overlap it partially, and n may be 0
+namespace mpn {
+    // names of the kernels picked for this CPU at startup, e.g. "portable", "adx" or "adx+avx512+ifma"
+    const char *kernels();
+
+    // sticks to the portable kernels even where faster ones are supported, for testing and
+    // benchmarking; not to be called while other threads use the library
+    void force_portable(bool on);
+
+    // r = a + b, returns the carry out
+    uint32_t add_n(uint32_t *r, uint32_t const *a, uint32_t const *b, size_t n);
+
+    // r = a - b, returns the borrow out
+    uint32_t sub_n(uint32_t *r, uint32_t const *a, uint32_t const *b, size_t n);
+
+    // r = a + b where a has n limbs
+    uint32_t add_1(uint32_t *r, uint32_t const *a, size_t n, uint32_t b);
+
+    uint32_t sub_1(uint32_t *r, uint32_t const *a, size_t n, uint32_t b);
+
+    // r = a + b for an >= bn, r gets an limbs
+    uint32_t add(uint32_t *r, uint32_t const *a, size_t an, uint32_t const *b, size_t bn);
+
+    // r = a - b for an >= bn, r gets an limbs
+    uint32_t sub(uint32_t *r, uint32_t const *a, size_t an, uint32_t const *b, size_t bn);
+
+    // r = a * b, returns the high limb
+    uint32_t mul_1(uint32_t *r, uint32_t const *a, size_t n, uint32_t b);
+
+    // r += a * b, returns the carry limb
+    uint32_t addmul_1(uint32_t *r, uint32_t const *a, size_t n, uint32_t b);
+
+    // r -= a * b, returns the borrow limb
+    uint32_t submul_1(uint32_t *r, uint32_t const *a, size_t n, uint32_t b);
+
+    // r = a << count for 0 < count < 32, returns the bits shifted out; r may also lie above a
+    uint32_t lshift(uint32_t *r, uint32_t const *a, size_t n, unsigned count);
+
+    // r = a >> count for 0 < count < 32, returns the bits shifted out in the high end of the limb;
+    // r may also lie below a
+    uint32_t rshift(uint32_t *r, uint32_t const *a, size_t n, unsigned count);
+
+    // -1, 0 or 1 as a is less than, equal to or greater than b
+    int cmp(uint32_t const *a, uint32_t const *b, size_t n);
+
+    // q = a / d, returns a % d
+    uint32_t divrem_1(uint32_t *q, uint32_t const *a, size_t n, uint32_t d);
+
+    uint32_t mod_1(uint32_t const *a, size_t n, uint32_t d);
+
+    // r = a * b, r has an + bn limbs and overlaps neither input; an, bn >= 1
+    void mul_basecase(uint32_t *r, uint32_t const *a, size_t an, uint32_t const *b, size_t bn);
+
+    // r = a * a, r has 2 * n limbs and doesn't overlap a; n >= 1
+    void sqr_basecase(uint32_t *r, uint32_t const *a, size_t n);
+
+    // q = a / d and r = a % d for an >= dn >= 2 and d[dn - 1] != 0. q gets an - dn + 1 limbs,
+    // r (if not null) dn limbs; neither overlaps the inputs
+    void tdiv_qr(uint32_t *q, uint32_t *r, uint32_t const *a, size_t an, uint32_t const *d, size_t dn);
+}
+
+#endif //MPN_H
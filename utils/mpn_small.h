@@ -0,0 +1,230 @@
+#ifndef MPN_SMALL_H
+#define MPN_SMALL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+// mpn kernels for operands of small_min to small_max limbs with the length as a template
+// parameter, so every loop over it is written out and each size compiles to straight-line code.
+// Both operands have N limbs; the caller pads a shorter one with zeros. big_integer picks the
+// instance with one jump on the limb count through small_switch
+namespace mpn {
+    const size_t small_min = 2;
+    const size_t small_max = 8;
+
+    // f(std::integral_constant<size_t, n>()) for small_min <= n <= small_max
+    template<class F>
+    inline auto small_switch(size_t n, F &&f) {
+        static_assert(small_min == 2 && small_max == 8, "small_switch lists the sizes one by one");
+        switch (n) {
+            case 2:
+                return f(std::integral_constant<size_t, 2>());
+            case 3:
+                return f(std::integral_constant<size_t, 3>());
+            case 4:
+                return f(std::integral_constant<size_t, 4>());
+            case 5:
+                return f(std::integral_constant<size_t, 5>());
+            case 6:
+                return f(std::integral_constant<size_t, 6>());
+            case 7:
+                return f(std::integral_constant<size_t, 7>());
+            default:
+                return f(std::integral_constant<size_t, 8>());
+        }
+    }
+
+    // the kernels below spell out their loops over the limbs as fold expressions over the index
+    // sequence I = 0, ..., N - 1, so no loop or call is left for the compiler to unroll
+
+    template<size_t... I>
+    inline uint32_t add_n(uint32_t *r, uint32_t const *a, uint32_t const *b, std::index_sequence<I...>) {
+        uint64_t carry = 0;
+        ((carry += static_cast<uint64_t>(a[I]) + b[I], r[I] = static_cast<uint32_t>(carry), carry >>= 32), ...);
+        return static_cast<uint32_t>(carry);
+    }
+
+    template<size_t N>
+    inline uint32_t add_n(uint32_t *r, uint32_t const *a, uint32_t const *b) {
+        return add_n(r, a, b, std::make_index_sequence<N>());
+    }
+
+    template<size_t... I>
+    inline uint32_t sub_n(uint32_t *r, uint32_t const *a, uint32_t const *b, std::index_sequence<I...>) {
+        uint64_t t = 0;
+        ((t = static_cast<uint64_t>(a[I]) - b[I] - (t >> 63), r[I] = static_cast<uint32_t>(t)), ...);
+        return static_cast<uint32_t>(t >> 63);
+    }
+
+    template<size_t N>
+    inline uint32_t sub_n(uint32_t *r, uint32_t const *a, uint32_t const *b) {
+        return sub_n(r, a, b, std::make_index_sequence<N>());
+    }
+
+    // r[0, n) += a * b over the n limbs of a, returns the carry limb
+    template<size_t... I>
+    inline uint32_t addmul_row(uint32_t *r, uint32_t const *a, uint64_t b, std::index_sequence<I...>) {
+        uint64_t carry = 0;
+        ((carry += a[I] * b + r[I], r[I] = static_cast<uint32_t>(carry), carry >>= 32), ...);
+        return static_cast<uint32_t>(carry);
+    }
+
+    // rows J, J + 1, ..., N - 1 of a * b, each one row of b long
+    template<size_t N, size_t J>
+    inline void mul_rows(uint32_t *r, uint32_t const *a, uint32_t const *b) {
+        if constexpr (J < N) {
+            r[J + N] = addmul_row(r + J, b, a[J], std::make_index_sequence<N>());
+            mul_rows<N, J + 1>(r, a, b);
+        }
+    }
+
+    // r = a * b with r of 2N limbs
+    template<size_t N>
+    inline void mul_n(uint32_t *r, uint32_t const *a, uint32_t const *b) {
+        for (size_t i = 0; i < N; ++i) {
+            r[i] = 0;
+        }
+        mul_rows<N, 0>(r, a, b);
+    }
+
+    // rows J, ..., N - 2 of the products above the diagonal of a * a; row J is a[J] times the
+    // N - J - 1 limbs above it
+    template<size_t N, size_t J>
+    inline void sqr_rows(uint32_t *r, uint32_t const *a) {
+        if constexpr (J + 1 < N) {
+            r[J + N] = addmul_row(r + 2 * J + 1, a + J + 1, a[J], std::make_index_sequence<N - J - 1>());
+            sqr_rows<N, J + 1>(r, a);
+        }
+    }
+
+    // r = 2 r + bit + x for one limb of r, where bit is the top bit of the limb below
+    inline void double_add(uint32_t &r, uint32_t x, uint32_t &bit, uint64_t &carry) {
+        uint32_t doubled = (r << 1) | bit;
+        bit = r >> 31;
+        carry += static_cast<uint64_t>(doubled) + x;
+        r = static_cast<uint32_t>(carry);
+        carry >>= 32;
+    }
+
+    // doubles the triangle and adds the squares of the limbs on the diagonal
+    template<size_t... I>
+    inline void sqr_diagonal(uint32_t *r, uint32_t const *a, std::index_sequence<I...>) {
+        uint32_t bit = 0;
+        uint64_t carry = 0;
+        uint64_t p = 0;
+        ((p = static_cast<uint64_t>(a[I]) * a[I],
+          double_add(r[2 * I], static_cast<uint32_t>(p), bit, carry),
+          double_add(r[2 * I + 1], static_cast<uint32_t>(p >> 32), bit, carry)), ...);
+    }
+
+    // r = a * a with r of 2N limbs; the products off the diagonal are taken once and doubled
+    template<size_t N>
+    inline void sqr_n(uint32_t *r, uint32_t const *a) {
+        for (size_t i = 0; i < 2 * N; ++i) {
+            r[i] = 0;
+        }
+        sqr_rows<N, 0>(r, a);
+        sqr_diagonal(r, a, std::make_index_sequence<N>());
+    }
+
+    // r[I] = a[I] << s with the bits from below, for 0 <= s < 32; spill masks them out when s == 0,
+    // where shifting by 32 - s would be undefined
+    template<size_t... I>
+    inline void shift_up(uint32_t *r, uint32_t const *a, unsigned s, uint32_t spill, std::index_sequence<I...>) {
+        unsigned back = (32 - s) & 31;
+        ((r[I] = (a[I] << s) | (I == 0 ? 0 : (a[I - (I != 0)] >> back) & spill)), ...);
+    }
+
+    // r[I] = a[I] >> s with the bits from above, a having one limb more than r
+    template<size_t... I>
+    inline void shift_down(uint32_t *r, uint32_t const *a, unsigned s, uint32_t spill, std::index_sequence<I...>) {
+        unsigned back = (32 - s) & 31;
+        ((r[I] = (a[I] >> s) | ((a[I + 1] << back) & spill)), ...);
+    }
+
+    // r[0, n) -= a * b over the n limbs of a, returns what is owed to the limb above, up to 2^32
+    template<size_t... I>
+    inline uint64_t submul_row(uint32_t *r, uint32_t const *a, uint64_t b, std::index_sequence<I...>) {
+        uint64_t carry = 0, borrow = 0, p = 0, t = 0;
+        ((p = b * a[I] + carry, carry = p >> 32,
+          t = static_cast<uint64_t>(r[I]) - static_cast<uint32_t>(p) - borrow,
+          r[I] = static_cast<uint32_t>(t), borrow = t >> 63), ...);
+        return carry + borrow;
+    }
+
+    // quotient limb J of algorithm D: un[J, J + DN] -= q * vn for the q estimated from its top limbs,
+    // added back once if that was one too many
+    template<size_t DN>
+    inline uint32_t divrem_step(uint32_t *un, uint32_t const *vn) {
+        const uint64_t base = uint64_t(1) << 32;
+        uint64_t d1 = vn[DN - 1];
+        uint64_t d0 = vn[DN - 2];
+        uint64_t top = (static_cast<uint64_t>(un[DN]) << 32) | un[DN - 1];
+        uint64_t qhat = top / d1;
+        uint64_t rhat = top % d1;
+        while (qhat >= base || qhat * d0 > ((rhat << 32) | un[DN - 2])) {
+            --qhat;
+            rhat += d1;
+            if (rhat >= base) {
+                break;
+            }
+        }
+
+        uint64_t t = static_cast<uint64_t>(un[DN]) - submul_row(un, vn, qhat, std::make_index_sequence<DN>());
+        un[DN] = static_cast<uint32_t>(t);
+        if (t >> 63) {
+            --qhat;
+            un[DN] += add_n<DN>(un, un, vn);
+        }
+        return static_cast<uint32_t>(qhat);
+    }
+
+    // the quotient limbs from the top down, J running over N - DN, ..., 0
+    template<size_t N, size_t DN, size_t... I>
+    inline void divrem_steps(uint32_t *q, uint32_t *un, uint32_t const *vn, std::index_sequence<I...>) {
+        ((q[N - DN - I] = divrem_step<DN>(un + (N - DN - I), vn)), ...);
+    }
+
+    // q = a / d and r = a % d for an N-limb a and a DN-limb d with 2 <= DN <= N and d[DN - 1] != 0;
+    // q gets N - DN + 1 limbs and r DN limbs. Algorithm D as in tdiv_qr, with the normalised copies
+    // on the stack; only the correction of each quotient estimate is left as a loop
+    template<size_t N, size_t DN>
+    inline void divrem_n(uint32_t *q, uint32_t *r, uint32_t const *a, uint32_t const *d) {
+        if constexpr (N == 2) {
+            uint64_t u = (static_cast<uint64_t>(a[1]) << 32) | a[0];
+            uint64_t v = (static_cast<uint64_t>(d[1]) << 32) | d[0];
+            q[0] = static_cast<uint32_t>(u / v);
+            u %= v;
+            r[0] = static_cast<uint32_t>(u);
+            r[1] = static_cast<uint32_t>(u >> 32);
+        } else {
+            unsigned s = 0;
+            while ((d[DN - 1] << s) < 0x80000000u) {
+                ++s;
+            }
+            uint32_t spill = s == 0 ? 0 : 0xffffffffu;
+            uint32_t un[N + 1];
+            uint32_t vn[DN];
+            shift_up(vn, d, s, spill, std::make_index_sequence<DN>());
+            shift_up(un, a, s, spill, std::make_index_sequence<N>());
+            un[N] = (a[N - 1] >> ((32 - s) & 31)) & spill;
+            divrem_steps<N, DN>(q, un, vn, std::make_index_sequence<N - DN + 1>());
+            shift_down(r, un, s, spill, std::make_index_sequence<DN>());
+        }
+    }
+
+    // divrem_n<N, DN> for the divisor length dn picked at run time by a second jump
+    template<size_t N>
+    inline void divrem_n(uint32_t *q, uint32_t *r, uint32_t const *a, uint32_t const *d, size_t dn) {
+        small_switch(dn, [&](auto size) {
+            constexpr size_t DN = decltype(size)::value;
+            if constexpr (DN <= N) {
+                divrem_n<N, DN>(q, r, a, d);
+            }
+        });
+    }
+}
+
+#endif //MPN_SMALL_H
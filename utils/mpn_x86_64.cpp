@@ -0,0 +1,603 @@
+#include "mpn_x86_64.h"
+
+#ifdef MPN_X86_64
+
+#include <algorithm>
+#include <cstring>
+#include <immintrin.h>
+#include "scratch_arena.h"
+
+#define AVX2 __attribute__((target("avx2")))
+#define AVX512 __attribute__((target("avx512f")))
+#define IFMA __attribute__((target("avx512f,avx512ifma")))
+
+typedef unsigned long long word;
+
+// limb arrays need not be 8-byte aligned, memcpy compiles to a plain move
+inline word load_word(uint32_t const *p) {
+    word w;
+    std::memcpy(&w, p, sizeof(w));
+    return w;
+}
+
+inline void store_word(uint32_t *p, word w) {
+    std::memcpy(p, &w, sizeof(w));
+}
+
+bool mpn::has_adx_bmi2() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("adx") && __builtin_cpu_supports("bmi2");
+}
+
+bool mpn::has_avx2() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+
+bool mpn::has_avx512() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx512f");
+}
+
+bool mpn::has_avx512_ifma() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512ifma");
+}
+
+// The word loops below are inline assembly: the compiler turns _addcarryx_u64 into a plain adc
+// chain, so only written out do the two ADX carry flags run as separate chains. Loop control
+// uses lea and jrcxz, which leave CF and OF alone. Each returns the carry word out of its top word
+
+// r = a + b over words words; adcx is the add with carry of the CF chain
+word add_words(uint32_t *r, uint32_t const *a, uint32_t const *b, size_t words) {
+    word t, carry = 0;
+    asm volatile(
+        "xor %k[t], %k[t]\n\t"
+        "1:\n\t"
+        "jrcxz 2f\n\t"
+        "mov (%[a]), %[t]\n\t"
+        "adcx (%[b]), %[t]\n\t"
+        "mov %[t], (%[r])\n\t"
+        "lea 8(%[a]), %[a]\n\t"
+        "lea 8(%[b]), %[b]\n\t"
+        "lea 8(%[r]), %[r]\n\t"
+        "lea -1(%[n]), %[n]\n\t"
+        "jmp 1b\n"
+        "2:\n\t"
+        "setc %b[c]"
+        : [r] "+r"(r), [a] "+r"(a), [b] "+r"(b), [n] "+c"(words), [t] "=&r"(t), [c] "+r"(carry)
+        :
+        : "cc", "memory");
+    return carry;
+}
+
+// r = a - b over words words; ADX has no subtraction, this is the sbb chain
+word sub_words(uint32_t *r, uint32_t const *a, uint32_t const *b, size_t words) {
+    word t, borrow = 0;
+    asm volatile(
+        "xor %k[t], %k[t]\n\t"
+        "1:\n\t"
+        "jrcxz 2f\n\t"
+        "mov (%[a]), %[t]\n\t"
+        "sbb (%[b]), %[t]\n\t"
+        "mov %[t], (%[r])\n\t"
+        "lea 8(%[a]), %[a]\n\t"
+        "lea 8(%[b]), %[b]\n\t"
+        "lea 8(%[r]), %[r]\n\t"
+        "lea -1(%[n]), %[n]\n\t"
+        "jmp 1b\n"
+        "2:\n\t"
+        "setc %b[c]"
+        : [r] "+r"(r), [a] "+r"(a), [b] "+r"(b), [n] "+c"(words), [t] "=&r"(t), [c] "+r"(borrow)
+        :
+        : "cc", "memory");
+    return borrow;
+}
+
+// r = a * b; mulx takes b from rdx and leaves the flags alone, adcx adds the previous high word
+word mul_1_words(uint32_t *r, uint32_t const *a, size_t words, word b) {
+    word lo, hi, prev = 0;
+    asm volatile(
+        "xor %k[lo], %k[lo]\n\t"
+        "1:\n\t"
+        "jrcxz 2f\n\t"
+        "mulx (%[a]), %[lo], %[hi]\n\t"
+        "adcx %[prev], %[lo]\n\t"
+        "mov %[lo], (%[r])\n\t"
+        "mov %[hi], %[prev]\n\t"
+        "lea 8(%[a]), %[a]\n\t"
+        "lea 8(%[r]), %[r]\n\t"
+        "lea -1(%[n]), %[n]\n\t"
+        "jmp 1b\n"
+        "2:\n\t"
+        "mov $0, %k[lo]\n\t"
+        "adcx %[lo], %[prev]"
+        : [r] "+r"(r), [a] "+r"(a), [n] "+c"(words), [lo] "=&r"(lo), [hi] "=&r"(hi), [prev] "+r"(prev)
+        : "d"(b)
+        : "cc", "memory");
+    return prev;
+}
+
+// r += a * b with two carry chains: adcx folds the previous high word into the product on CF,
+// adox adds the result to r on OF, so neither addition waits for the other's carry
+word addmul_1_words(uint32_t *r, uint32_t const *a, size_t words, word b) {
+    word lo, hi, prev = 0;
+    asm volatile(
+        "xor %k[lo], %k[lo]\n\t"
+        "1:\n\t"
+        "jrcxz 2f\n\t"
+        "mulx (%[a]), %[lo], %[hi]\n\t"
+        "adcx %[prev], %[lo]\n\t"
+        "adox (%[r]), %[lo]\n\t"
+        "mov %[lo], (%[r])\n\t"
+        "mov %[hi], %[prev]\n\t"
+        "lea 8(%[a]), %[a]\n\t"
+        "lea 8(%[r]), %[r]\n\t"
+        "lea -1(%[n]), %[n]\n\t"
+        "jmp 1b\n"
+        "2:\n\t"
+        "mov $0, %k[lo]\n\t"
+        "adcx %[lo], %[prev]\n\t"
+        "adox %[lo], %[prev]"
+        : [r] "+r"(r), [a] "+r"(a), [n] "+c"(words), [lo] "=&r"(lo), [hi] "=&r"(hi), [prev] "+r"(prev)
+        : "d"(b)
+        : "cc", "memory");
+    return prev;
+}
+
+// r -= a * b, returns the borrow word. The product words are summed on OF with adox; r - x is
+// taken as r + ~x + 1 on CF with adcx, started at CF = 1, so a clear CF at the end owes one more
+word submul_1_words(uint32_t *r, uint32_t const *a, size_t words, word b) {
+    word lo, hi, prev = 0;
+    asm volatile(
+        "xor %k[lo], %k[lo]\n\t"
+        "stc\n"
+        "1:\n\t"
+        "jrcxz 2f\n\t"
+        "mulx (%[a]), %[lo], %[hi]\n\t"
+        "adox %[prev], %[lo]\n\t"
+        "not %[lo]\n\t"
+        "adcx (%[r]), %[lo]\n\t"
+        "mov %[lo], (%[r])\n\t"
+        "mov %[hi], %[prev]\n\t"
+        "lea 8(%[a]), %[a]\n\t"
+        "lea 8(%[r]), %[r]\n\t"
+        "lea -1(%[n]), %[n]\n\t"
+        "jmp 1b\n"
+        "2:\n\t"
+        "mov $0, %k[lo]\n\t"
+        "adox %[lo], %[prev]\n\t"
+        "setnc %b[lo]\n\t"
+        "add %[lo], %[prev]"
+        : [r] "+r"(r), [a] "+r"(a), [n] "+c"(words), [lo] "=&r"(lo), [hi] "=&r"(hi), [prev] "+r"(prev)
+        : "d"(b)
+        : "cc", "memory");
+    return prev;
+}
+
+// the limb entry points run the word loops over n / 2 words and finish an odd limb in C++;
+// a word times a limb has a high part below 2^32, so the carry words fit a limb
+uint32_t mpn::adx_add_n(uint32_t *r, uint32_t const *a, uint32_t const *b, size_t n) {
+    size_t i = n & ~size_t(1);
+    uint64_t carry = add_words(r, a, b, n / 2);
+    if (i < n) {
+        carry += static_cast<uint64_t>(a[i]) + b[i];
+        r[i] = static_cast<uint32_t>(carry);
+        carry >>= 32;
+    }
+    return static_cast<uint32_t>(carry);
+}
+
+uint32_t mpn::adx_sub_n(uint32_t *r, uint32_t const *a, uint32_t const *b, size_t n) {
+    size_t i = n & ~size_t(1);
+    uint64_t borrow = sub_words(r, a, b, n / 2);
+    if (i < n) {
+        uint64_t t = static_cast<uint64_t>(a[i]) - b[i] - borrow;
+        r[i] = static_cast<uint32_t>(t);
+        borrow = t >> 63;
+    }
+    return static_cast<uint32_t>(borrow);
+}
+
+uint32_t mpn::adx_mul_1(uint32_t *r, uint32_t const *a, size_t n, uint32_t b) {
+    size_t i = n & ~size_t(1);
+    uint64_t carry = mul_1_words(r, a, n / 2, b);
+    if (i < n) {
+        carry += static_cast<uint64_t>(a[i]) * b;
+        r[i] = static_cast<uint32_t>(carry);
+        carry >>= 32;
+    }
+    return static_cast<uint32_t>(carry);
+}
+
+uint32_t mpn::adx_addmul_1(uint32_t *r, uint32_t const *a, size_t n, uint32_t b) {
+    size_t i = n & ~size_t(1);
+    uint64_t carry = addmul_1_words(r, a, n / 2, b);
+    if (i < n) {
+        carry += static_cast<uint64_t>(a[i]) * b + r[i];
+        r[i] = static_cast<uint32_t>(carry);
+        carry >>= 32;
+    }
+    return static_cast<uint32_t>(carry);
+}
+
+uint32_t mpn::adx_submul_1(uint32_t *r, uint32_t const *a, size_t n, uint32_t b) {
+    size_t i = n & ~size_t(1);
+    uint64_t borrow = submul_1_words(r, a, n / 2, b);
+    if (i < n) {
+        uint64_t p = static_cast<uint64_t>(a[i]) * b + borrow;
+        uint64_t t = static_cast<uint64_t>(r[i]) - static_cast<uint32_t>(p);
+        r[i] = static_cast<uint32_t>(t);
+        borrow = (p >> 32) + (t >> 63);
+    }
+    return static_cast<uint32_t>(borrow);
+}
+
+// r[0, words + 4) = r[0, words) + b * (x[0] + x[1] W + x[2] W^2 + x[3] W^3) for the word W = 2^64,
+// four rows at once so r is read and written once per four rows. c0..c3 are the columns j..j + 3
+// of the sum; for word j of b, adcx adds each low product to its column and each high one to the
+// column above, adox adds r[j] and the remaining low products. What is left after c0 goes out to
+// r[j] stays below W^4, so the top column takes both carries and both flags end the word clear,
+// which lets dec, clearing OF and keeping CF, count the loop
+void addmul_4_words(uint32_t *r, uint32_t const *b, size_t words, uint32_t const *x) {
+    word c0 = 0, c1 = 0, c2 = 0, c3 = 0, lo, hi, zero;
+    asm volatile(
+        "xor %k[zero], %k[zero]\n\t"
+        "jrcxz 2f\n"
+        "1:\n\t"
+        "mov (%[b]), %%rdx\n\t"
+        "mulx (%[x]), %[lo], %[hi]\n\t"
+        "adcx %[lo], %[c0]\n\t"
+        "adox (%[r]), %[c0]\n\t"
+        "adcx %[hi], %[c1]\n\t"
+        "mulx 8(%[x]), %[lo], %[hi]\n\t"
+        "adox %[lo], %[c1]\n\t"
+        "adcx %[hi], %[c2]\n\t"
+        "mulx 16(%[x]), %[lo], %[hi]\n\t"
+        "adox %[lo], %[c2]\n\t"
+        "adcx %[hi], %[c3]\n\t"
+        "mulx 24(%[x]), %[lo], %[hi]\n\t"
+        "adox %[lo], %[c3]\n\t"
+        "adcx %[zero], %[hi]\n\t"
+        "adox %[zero], %[hi]\n\t"
+        "mov %[c0], (%[r])\n\t"
+        "mov %[c1], %[c0]\n\t"
+        "mov %[c2], %[c1]\n\t"
+        "mov %[c3], %[c2]\n\t"
+        "mov %[hi], %[c3]\n\t"
+        "lea 8(%[b]), %[b]\n\t"
+        "lea 8(%[r]), %[r]\n\t"
+        "dec %[n]\n\t"
+        "jnz 1b\n"
+        "2:\n\t"
+        "mov %[c0], (%[r])\n\t"
+        "mov %[c1], 8(%[r])\n\t"
+        "mov %[c2], 16(%[r])\n\t"
+        "mov %[c3], 24(%[r])"
+        : [r] "+r"(r), [b] "+r"(b), [n] "+c"(words), [c0] "+r"(c0), [c1] "+r"(c1), [c2] "+r"(c2),
+          [c3] "+r"(c3), [lo] "=&r"(lo), [hi] "=&r"(hi), [zero] "=&r"(zero)
+        : [x] "r"(x)
+        : "rdx", "cc", "memory");
+}
+
+// adds c at word r and carries as far as needed; the caller knows the sum fits
+inline void add_word_at(uint32_t *r, word c) {
+    for (; c != 0; r += 2) {
+        word s = load_word(r) + c;
+        store_word(r, s);
+        c = s < c;
+    }
+}
+
+// copy of n limbs padded with a zero limb to whole words, or a itself when n is even
+uint32_t const *whole_words(scratch_frame &frame, uint32_t const *a, size_t n) {
+    if (n % 2 == 0) {
+        return a;
+    }
+    uint32_t *x = frame.allocate(n + 1);
+    std::memcpy(x, a, sizeof(uint32_t) * n);
+    x[n] = 0;
+    return x;
+}
+
+// the rows of a run over b four words at a time, as mul_rows does with limbs; odd lengths are
+// padded with a zero limb in the scratch arena, so the rows run on whole words
+void mpn::adx_mul_basecase(uint32_t *r, uint32_t const *a, size_t an, uint32_t const *b, size_t bn) {
+    size_t aw = (an + 1) / 2;
+    size_t bw = (bn + 1) / 2;
+    scratch_frame frame;
+    a = whole_words(frame, a, an);
+    b = whole_words(frame, b, bn);
+    uint32_t *z = an % 2 == 0 && bn % 2 == 0 ? r : frame.allocate(2 * (aw + bw));
+
+    store_word(z + 2 * bw, mul_1_words(z, b, bw, load_word(a)));
+    size_t i = 1;
+    for (; i + 4 <= aw; i += 4) {
+        addmul_4_words(z + 2 * i, b, bw, a + 2 * i);
+    }
+    for (; i < aw; ++i) {
+        store_word(z + 2 * (i + bw), addmul_1_words(z + 2 * i, b, bw, load_word(a + 2 * i)));
+    }
+    if (z != r) {
+        std::memcpy(r, z, sizeof(uint32_t) * (an + bn));
+    }
+}
+
+// sqr_basecase over words: the products above the diagonal once, four rows at a time, then
+// doubled with the squares of the words added in one pass
+void mpn::adx_sqr_basecase(uint32_t *r, uint32_t const *a, size_t n) {
+    size_t w = (n + 1) / 2;
+    scratch_frame frame;
+    a = whole_words(frame, a, n);
+    uint32_t *z = n % 2 == 0 ? r : frame.allocate(4 * w);
+    std::memset(z, 0, sizeof(uint32_t) * 4 * w);
+
+    size_t row = 0;
+    for (; row + 4 < w; row += 4) {
+        // the group against the words above it, which stores the four columns over the rows
+        // so far, then the six products inside the group
+        addmul_4_words(z + 2 * (2 * row + 4), a + 2 * (row + 4), w - row - 4, a + 2 * row);
+        for (size_t k = 0; k != 3; ++k) {
+            word c = addmul_1_words(z + 2 * (2 * row + 2 * k + 1), a + 2 * (row + k + 1), 3 - k,
+                                    load_word(a + 2 * (row + k)));
+            add_word_at(z + 2 * (2 * row + k + 4), c);
+        }
+    }
+    for (; row + 1 < w; ++row) {
+        add_word_at(z + 2 * (w + row), addmul_1_words(z + 2 * (2 * row + 1), a + 2 * (row + 1), w - row - 1,
+                                                      load_word(a + 2 * row)));
+    }
+    // doubled a word at a time, the top bit of each word going into the one above
+    word bit = 0;
+    unsigned char carry = 0;
+    for (size_t i = 0; i < w; ++i) {
+        word x = load_word(a + 2 * i);
+        unsigned __int128 p = static_cast<unsigned __int128>(x) * x;
+        for (size_t k = 0; k != 2; ++k) {
+            word t = load_word(z + 4 * i + 2 * k);
+            word doubled = (t << 1) | bit;
+            bit = t >> 63;
+            carry = _addcarry_u64(carry, doubled, static_cast<word>(p >> (64 * k)), &t);
+            store_word(z + 4 * i + 2 * k, t);
+        }
+    }
+    if (z != r) {
+        std::memcpy(r, z, sizeof(uint32_t) * 2 * n);
+    }
+}
+
+// limbs left over after the vector loop
+uint32_t tail_add(uint32_t *r, uint32_t const *a, uint32_t const *b, size_t n, uint32_t carry) {
+    uint64_t sum = carry;
+    for (size_t i = 0; i < n; ++i) {
+        sum += static_cast<uint64_t>(a[i]) + b[i];
+        r[i] = static_cast<uint32_t>(sum);
+        sum >>= 32;
+    }
+    return static_cast<uint32_t>(sum);
+}
+
+uint32_t tail_sub(uint32_t *r, uint32_t const *a, uint32_t const *b, size_t n, uint32_t borrow) {
+    uint64_t out = borrow;
+    for (size_t i = 0; i < n; ++i) {
+        uint64_t t = static_cast<uint64_t>(a[i]) - b[i] - out;
+        r[i] = static_cast<uint32_t>(t);
+        out = t >> 63;
+    }
+    return static_cast<uint32_t>(out);
+}
+
+// g marks lanes whose sum overflowed, p lanes that pass an incoming carry on (all ones).
+// They never overlap, so adding p to the carries that g and carry_in create ripples each
+// carry through the run of p lanes above it: a lane receives a carry where the result differs from p
+inline uint32_t lane_carries(uint32_t g, uint32_t p, uint32_t carry_in, unsigned lanes, uint32_t &carry_out) {
+    uint32_t t = ((g << 1) | carry_in) + p;
+    carry_out = t >> lanes;
+    return (t ^ p) & ((uint32_t(1) << lanes) - 1);
+}
+
+// bit i of the mask as lane i of all ones or zero
+AVX2 inline __m256i expand_mask(uint32_t mask) {
+    const __m256i bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    __m256i m = _mm256_and_si256(_mm256_set1_epi32(static_cast<int>(mask)), bits);
+    return _mm256_cmpeq_epi32(m, bits);
+}
+
+AVX2 inline uint32_t lane_mask(__m256i v) {
+    return static_cast<uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(v)));
+}
+
+AVX2 uint32_t mpn::avx2_add_n(uint32_t *r, uint32_t const *a, uint32_t const *b, size_t n) {
+    const __m256i bias = _mm256_set1_epi32(INT32_MIN);
+    const __m256i ones = _mm256_set1_epi32(-1);
+    uint32_t carry = 0;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(a + i));
+        __m256i y = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(b + i));
+        __m256i s = _mm256_add_epi32(x, y);
+        // unsigned s < x through the signed compare of both with the top bit flipped
+        uint32_t g = lane_mask(_mm256_cmpgt_epi32(_mm256_xor_si256(x, bias), _mm256_xor_si256(s, bias)));
+        uint32_t p = lane_mask(_mm256_cmpeq_epi32(s, ones));
+        uint32_t c = lane_carries(g, p, carry, 8, carry);
+        s = _mm256_sub_epi32(s, expand_mask(c));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(r + i), s);
+    }
+    return tail_add(r + i, a + i, b + i, n - i, carry);
+}
+
+AVX2 uint32_t mpn::avx2_sub_n(uint32_t *r, uint32_t const *a, uint32_t const *b, size_t n) {
+    const __m256i bias = _mm256_set1_epi32(INT32_MIN);
+    const __m256i zero = _mm256_setzero_si256();
+    uint32_t borrow = 0;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(a + i));
+        __m256i y = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(b + i));
+        __m256i d = _mm256_sub_epi32(x, y);
+        uint32_t g = lane_mask(_mm256_cmpgt_epi32(_mm256_xor_si256(y, bias), _mm256_xor_si256(x, bias)));
+        uint32_t p = lane_mask(_mm256_cmpeq_epi32(d, zero));
+        uint32_t c = lane_carries(g, p, borrow, 8, borrow);
+        d = _mm256_add_epi32(d, expand_mask(c));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(r + i), d);
+    }
+    return tail_sub(r + i, a + i, b + i, n - i, borrow);
+}
+
+AVX512 uint32_t mpn::avx512_add_n(uint32_t *r, uint32_t const *a, uint32_t const *b, size_t n) {
+    const __m512i ones = _mm512_set1_epi32(-1);
+    uint32_t carry = 0;
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512i x = _mm512_loadu_si512(a + i);
+        __m512i y = _mm512_loadu_si512(b + i);
+        __m512i s = _mm512_add_epi32(x, y);
+        uint32_t g = _mm512_cmplt_epu32_mask(s, x);
+        uint32_t p = _mm512_cmpeq_epi32_mask(s, ones);
+        __mmask16 c = static_cast<__mmask16>(lane_carries(g, p, carry, 16, carry));
+        s = _mm512_mask_sub_epi32(s, c, s, ones);
+        _mm512_storeu_si512(r + i, s);
+    }
+    return tail_add(r + i, a + i, b + i, n - i, carry);
+}
+
+AVX512 uint32_t mpn::avx512_sub_n(uint32_t *r, uint32_t const *a, uint32_t const *b, size_t n) {
+    const __m512i ones = _mm512_set1_epi32(-1);
+    const __m512i zero = _mm512_setzero_si512();
+    uint32_t borrow = 0;
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512i x = _mm512_loadu_si512(a + i);
+        __m512i y = _mm512_loadu_si512(b + i);
+        __m512i d = _mm512_sub_epi32(x, y);
+        uint32_t g = _mm512_cmplt_epu32_mask(x, y);
+        uint32_t p = _mm512_cmpeq_epi32_mask(d, zero);
+        __mmask16 c = static_cast<__mmask16>(lane_carries(g, p, borrow, 16, borrow));
+        d = _mm512_mask_add_epi32(d, c, d, ones);
+        _mm512_storeu_si512(r + i, d);
+    }
+    return tail_sub(r + i, a + i, b + i, n - i, borrow);
+}
+
+const uint64_t DIGIT_MASK = (uint64_t(1) << 52) - 1;
+
+typedef unsigned __int128 bits_buffer;
+
+// n limbs as size radix-2^52 digits, zero-padded
+void to_digits(uint64_t *d, size_t size, uint32_t const *a, size_t n) {
+    bits_buffer buf = 0;
+    unsigned bits = 0;
+    size_t i = 0;
+    for (size_t k = 0; k < size; ++k) {
+        while (bits < 52 && i < n) {
+            buf |= static_cast<bits_buffer>(a[i++]) << bits;
+            bits += 32;
+        }
+        d[k] = static_cast<uint64_t>(buf) & DIGIT_MASK;
+        buf >>= 52;
+        bits = bits > 52 ? bits - 52 : 0;
+    }
+}
+
+// n limbs of the sum of lo[k] and hi[k] shifted up one digit, over columns digits
+void from_columns(uint32_t *r, size_t n, uint64_t const *lo, uint64_t const *hi, size_t columns) {
+    bits_buffer carry = 0;
+    bits_buffer out = 0;
+    unsigned bits = 0;
+    size_t i = 0;
+    for (size_t k = 0; i < n; ++k) {
+        if (k < columns) {
+            carry += lo[k];
+        }
+        if (k != 0 && k <= columns) {
+            carry += hi[k - 1];
+        }
+        out |= (carry & DIGIT_MASK) << bits;
+        carry >>= 52;
+        bits += 52;
+        while (bits >= 32 && i < n) {
+            r[i++] = static_cast<uint32_t>(out);
+            out >>= 32;
+            bits -= 32;
+        }
+    }
+}
+
+// digits with room for the zero lanes read around them by the column loops
+struct ifma_operand {
+    uint64_t *digits;
+    size_t size;
+
+    ifma_operand(scratch_frame &frame, uint32_t const *a, size_t n) : size((32 * n + 51) / 52) {
+        uint32_t *block = frame.allocate(2 * (size + 16));
+        digits = reinterpret_cast<uint64_t *>(block) + 8;
+        std::memset(digits - 8, 0, sizeof(uint64_t) * 8);
+        to_digits(digits, size + 8, a, n);
+    }
+};
+
+// product scanning: every block of 8 columns is summed in registers over the rows that reach it,
+// the lanes read y backwards from a sliding offset
+IFMA void mpn::ifma_mul_basecase(uint32_t *r, uint32_t const *a, size_t an, uint32_t const *b, size_t bn) {
+    if (an > bn) {
+        std::swap(a, b);
+        std::swap(an, bn);
+    }
+    scratch_frame frame;
+    ifma_operand x(frame, a, an);
+    ifma_operand y(frame, b, bn);
+    size_t columns = (x.size + y.size + 7) / 8 * 8;
+    uint64_t *lo = reinterpret_cast<uint64_t *>(frame.allocate(2 * columns));
+    uint64_t *hi = reinterpret_cast<uint64_t *>(frame.allocate(2 * columns));
+
+    for (size_t k = 0; k < columns; k += 8) {
+        __m512i acc_lo = _mm512_setzero_si512();
+        __m512i acc_hi = _mm512_setzero_si512();
+        size_t first = k >= y.size ? k - y.size + 1 : 0;
+        size_t last = std::min(x.size, k + 8);
+        for (size_t i = first; i < last; ++i) {
+            __m512i xi = _mm512_set1_epi64(static_cast<long long>(x.digits[i]));
+            __m512i yj = _mm512_loadu_si512(y.digits + k - i);
+            acc_lo = _mm512_madd52lo_epu64(acc_lo, xi, yj);
+            acc_hi = _mm512_madd52hi_epu64(acc_hi, xi, yj);
+        }
+        _mm512_storeu_si512(lo + k, acc_lo);
+        _mm512_storeu_si512(hi + k, acc_hi);
+    }
+    from_columns(r, an + bn, lo, hi, columns);
+}
+
+// only the products below the diagonal are summed, masked per lane, then doubled and the squares added
+IFMA void mpn::ifma_sqr_basecase(uint32_t *r, uint32_t const *a, size_t n) {
+    scratch_frame frame;
+    ifma_operand x(frame, a, n);
+    size_t columns = (2 * x.size + 7) / 8 * 8;
+    uint64_t *lo = reinterpret_cast<uint64_t *>(frame.allocate(2 * columns));
+    uint64_t *hi = reinterpret_cast<uint64_t *>(frame.allocate(2 * columns));
+
+    for (size_t k = 0; k < columns; k += 8) {
+        __m512i acc_lo = _mm512_setzero_si512();
+        __m512i acc_hi = _mm512_setzero_si512();
+        size_t first = k >= x.size ? k - x.size + 1 : 0;
+        size_t last = std::min(x.size, k / 2 + 4);
+        for (size_t i = first; i < last; ++i) {
+            // lane l is column k + l and takes x[i] * x[k + l - i] only while i < k + l - i
+            ptrdiff_t t = static_cast<ptrdiff_t>(2 * i) - static_cast<ptrdiff_t>(k);
+            __mmask8 below = t < 0 ? 0xff : static_cast<__mmask8>(0xff << (t + 1));
+            __m512i xi = _mm512_set1_epi64(static_cast<long long>(x.digits[i]));
+            __m512i yj = _mm512_loadu_si512(x.digits + k - i);
+            acc_lo = _mm512_mask_madd52lo_epu64(acc_lo, below, xi, yj);
+            acc_hi = _mm512_mask_madd52hi_epu64(acc_hi, below, xi, yj);
+        }
+        _mm512_storeu_si512(lo + k, _mm512_add_epi64(acc_lo, acc_lo));
+        _mm512_storeu_si512(hi + k, _mm512_add_epi64(acc_hi, acc_hi));
+    }
+    for (size_t i = 0; i < x.size; ++i) {
+        bits_buffer p = static_cast<bits_buffer>(x.digits[i]) * x.digits[i];
+        lo[2 * i] += static_cast<uint64_t>(p) & DIGIT_MASK;
+        hi[2 * i] += static_cast<uint64_t>(p >> 52);
+    }
+    from_columns(r, 2 * n, lo, hi, columns);
+}
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef MPN_X86_64_H
+#define MPN_X86_64_H
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define MPN_X86_64 1
+#endif
+
+#ifdef MPN_X86_64
+
+// x86-64 mpn kernels, each only to be called when the matching has_ function is true;
+// mpn.cpp dispatches to them.
+// adx_ ones work on 64-bit words, pairs of limbs, in inline assembly with BMI2 mulx and the
+// adcx/adox carry chains; adx_sub_n is a plain sbb loop, there being no ADX subtraction.
+// avx2_ and avx512_ ones add 8 or 16 limbs at once and resolve the carries between
+// the lanes with one scalar addition over the lane masks.
+// ifma_ ones multiply in radix 2^52 with vpmadd52luq/vpmadd52huq, converting the limbs on the
+// way in and out; the column sums stay exact while the shorter operand has at most ifma_max_limbs
+namespace mpn {
+    const size_t ifma_max_limbs = 6400;
+
+    bool has_adx_bmi2();
+
+    bool has_avx2();
+
+    bool has_avx512();
+
+    bool has_avx512_ifma();
+
+    uint32_t adx_add_n(uint32_t *r, uint32_t const *a, uint32_t const *b, size_t n);
+
+    uint32_t adx_sub_n(uint32_t *r, uint32_t const *a, uint32_t const *b, size_t n);
+
+    uint32_t adx_mul_1(uint32_t *r, uint32_t const *a, size_t n, uint32_t b);
+
+    uint32_t adx_addmul_1(uint32_t *r, uint32_t const *a, size_t n, uint32_t b);
+
+    uint32_t adx_submul_1(uint32_t *r, uint32_t const *a, size_t n, uint32_t b);
+
+    void adx_mul_basecase(uint32_t *r, uint32_t const *a, size_t an, uint32_t const *b, size_t bn);
+
+    void adx_sqr_basecase(uint32_t *r, uint32_t const *a, size_t n);
+
+    uint32_t avx2_add_n(uint32_t *r, uint32_t const *a, uint32_t const *b, size_t n);
+
+    uint32_t avx2_sub_n(uint32_t *r, uint32_t const *a, uint32_t const *b, size_t n);
+
+    uint32_t avx512_add_n(uint32_t *r, uint32_t const *a, uint32_t const *b, size_t n);
+
+    uint32_t avx512_sub_n(uint32_t *r, uint32_t const *a, uint32_t const *b, size_t n);
+
+    void ifma_mul_basecase(uint32_t *r, uint32_t const *a, size_t an, uint32_t const *b, size_t bn);
+
+    void ifma_sqr_basecase(uint32_t *r, uint32_t const *a, size_t n);
+}
+
+#endif
+
+#endif //MPN_X86_64_H
@@ -0,0 +1,112 @@
+#include <algorithm>
+#include <new>
+#include <vector>
+#include "scratch_arena.h"
+#include "huge_page_resource.h"
+#include "smart_vector.h"
+
+const size_t LINE_LIMBS = 16;
+const size_t MIN_CHUNK_LIMBS = 4096;
+
+struct scratch_chunk {
+    uint32_t *limbs;
+    size_t size;
+    bool mapped;
+};
+
+const size_t LINE_BYTES = sizeof(uint32_t) * LINE_LIMBS;
+
+// a buffer taken from the resource of a limb_resource_scope, given back when its frame ends
+struct scoped_block {
+    void *p;
+    size_t bytes;
+    std::pmr::memory_resource *resource;
+};
+
+// chunks only grow; top is the first free limb of the current chunk
+struct scratch_arena {
+    std::vector<scratch_chunk> chunks;
+    size_t current = 0;
+    size_t top = 0;
+    std::vector<scoped_block> scoped;
+
+    ~scratch_arena() {
+        release_from(0);
+    }
+
+    void release_from(size_t first) {
+        for (size_t i = first; i < chunks.size(); ++i) {
+            if (chunks[i].mapped) {
+                huge_page_resource::instance()->deallocate(chunks[i].limbs, sizeof(uint32_t) * chunks[i].size, LINE_BYTES);
+            } else {
+                ::operator delete(chunks[i].limbs, std::align_val_t(LINE_BYTES));
+            }
+        }
+        chunks.resize(std::min(first, chunks.size()));
+    }
+};
+
+thread_local scratch_arena arena;
+
+scratch_frame::scratch_frame() :
+        chunk(arena.current),
+        offset(arena.top),
+        scoped(arena.scoped.size()) {}
+
+scratch_frame::~scratch_frame() {
+    while (arena.scoped.size() > scoped) {
+        scoped_block const &b = arena.scoped.back();
+        b.resource->deallocate(b.p, b.bytes, LINE_BYTES);
+        arena.scoped.pop_back();
+    }
+    arena.current = chunk;
+    arena.top = offset;
+}
+
+// a request that doesn't fit moves on to the next chunk, the tail of the current one waits for the frame to end
+uint32_t *scratch_frame::allocate(size_t limbs) {
+    limbs = (limbs + LINE_LIMBS - 1) / LINE_LIMBS * LINE_LIMBS;
+    if (std::pmr::memory_resource *resource = limb_resource_scope::current()) {
+        arena.scoped.reserve(arena.scoped.size() + 1);
+        void *p = resource->allocate(sizeof(uint32_t) * limbs, LINE_BYTES);
+        arena.scoped.push_back({p, sizeof(uint32_t) * limbs, resource});
+        return static_cast<uint32_t *>(p);
+    }
+    while (true) {
+        if (arena.current < arena.chunks.size()) {
+            scratch_chunk &c = arena.chunks[arena.current];
+            if (arena.top + limbs <= c.size) {
+                uint32_t *r = c.limbs + arena.top;
+                arena.top += limbs;
+                return r;
+            }
+            ++arena.current;
+            arena.top = 0;
+        } else {
+            size_t size = arena.chunks.empty() ? MIN_CHUNK_LIMBS : 2 * arena.chunks.back().size;
+            size = std::max(size, limbs);
+            arena.chunks.reserve(arena.chunks.size() + 1);
+            bool mapped = huge_page_resource::is_used_for(sizeof(uint32_t) * size);
+            void *block;
+            if (mapped) {
+                size = huge_page_resource::round_up(sizeof(uint32_t) * size) / sizeof(uint32_t);
+                block = huge_page_resource::instance()->allocate(sizeof(uint32_t) * size, LINE_BYTES);
+            } else {
+                block = ::operator new(sizeof(uint32_t) * size, std::align_val_t(LINE_BYTES));
+            }
+            arena.chunks.push_back({static_cast<uint32_t *>(block), size, mapped});
+        }
+    }
+}
+
+size_t scratch_frame::reserved() {
+    size_t r = 0;
+    for (scratch_chunk const &c : arena.chunks) {
+        r += c.size;
+    }
+    return r;
+}
+
+void scratch_frame::trim() {
+    arena.release_from(arena.top == 0 ? arena.current : arena.current + 1);
+}
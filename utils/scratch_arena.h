@@ -0,0 +1,35 @@
+#ifndef SCRATCH_ARENA_H
+#define SCRATCH_ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+
+// per-thread stack of limb buffers for the temporaries of the arithmetic algorithms.
+// Buffers are taken through a frame and released all at once when it ends, the memory
+// stays with the thread for the next computation. Inside a limb_resource_scope they come
+// from its resource instead and go back to it with the frame. Frames must end in reverse order
+struct scratch_frame {
+    scratch_frame();
+
+    scratch_frame(scratch_frame const &other) = delete;
+
+    scratch_frame &operator=(scratch_frame const &other) = delete;
+
+    ~scratch_frame();
+
+    // uninitialised and cache-line aligned, valid until the frame ends
+    uint32_t *allocate(size_t limbs);
+
+    // limbs held by the arena of the calling thread
+    static size_t reserved();
+
+    // frees the chunks of the calling thread that no live frame uses
+    static void trim();
+
+private:
+    size_t chunk;
+    size_t offset;
+    size_t scoped;
+};
+
+#endif //SCRATCH_ARENA_H
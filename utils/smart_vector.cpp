@@ -1,25 +1,107 @@
+#include <algorithm>
 #include <cassert>
+#include <cstdint>
 #include <cstring>
+#include <new>
 #include "smart_vector.h"
+#include "limb_pool.h"
+#include "huge_page_resource.h"
+#include "memory_budget.h"
 
-smart_vector::smart_data::smart_data(size_t new_capacity) :
-        capacity(new_capacity),
-        data(new uint32_t[new_capacity]) {
-    std::memset(data, 0, sizeof(uint32_t) * capacity);
+thread_local std::pmr::memory_resource *current_resource = nullptr;
+
+limb_resource_scope::limb_resource_scope(std::pmr::memory_resource *resource) :
+        previous(current_resource) {
+    current_resource = resource;
+}
+
+limb_resource_scope::~limb_resource_scope() {
+    current_resource = previous;
+}
+
+std::pmr::memory_resource *limb_resource_scope::current() {
+    return current_resource;
+}
+
+smart_vector::smart_data::smart_data(size_t capacity, uint32_t *data, std::pmr::memory_resource *resource,
+                                     unsigned charged) :
+        capacity(capacity),
+        data(data),
+        resource(resource),
+        charged(charged) {}
+
+// a scoped resource comes first, otherwise big blocks are mapped and the rest comes from the limb pool
+std::pmr::memory_resource *smart_vector::smart_data::source(size_t capacity) {
+    if (current_resource == nullptr && huge_page_resource::is_used_for(sizeof(smart_data) + sizeof(uint32_t) * capacity)) {
+        return huge_page_resource::instance();
+    }
+    return current_resource;
+}
+
+// pool blocks fill their size class, mapped ones whole huge pages, others whole cache lines.
+// No allocator can give out half the address space, so larger requests fail here, before the byte
+// count or its rounding can wrap around to a small block
+size_t smart_vector::smart_data::block_size(size_t capacity, std::pmr::memory_resource *resource) {
+    if (capacity > (SIZE_MAX / 2 - sizeof(smart_data)) / sizeof(uint32_t)) {
+        throw std::bad_alloc();
+    }
+    size_t bytes = sizeof(smart_data) + sizeof(uint32_t) * capacity;
+    if (resource == nullptr) {
+        return limb_pool::round_up(bytes);
+    }
+    if (resource == huge_page_resource::instance()) {
+        return huge_page_resource::round_up(bytes);
+    }
+    return (bytes + line_size - 1) / line_size * line_size;
+}
+
+// the block is charged to the memory budget before it is taken
+void *smart_vector::smart_data::allocate(size_t bytes, std::pmr::memory_resource *resource, unsigned &charged) {
+    charged = memory_budget::charge(bytes);
+    try {
+        if (resource == nullptr) {
+            return limb_pool::allocate(bytes);
+        }
+        return resource->allocate(bytes, line_size);
+    } catch (...) {
+        memory_budget::release(bytes, charged);
+        throw;
+    }
+}
+
+// capacity grows to fill the whole block, the slack would be wasted anyway
+smart_vector::smart_data *smart_vector::smart_data::create(size_t new_capacity) {
+    std::pmr::memory_resource *resource = source(new_capacity);
+    size_t bytes = block_size(new_capacity, resource);
+    new_capacity = (bytes - sizeof(smart_data)) / sizeof(uint32_t);
+    unsigned charged;
+    smart_data *block = static_cast<smart_data *>(allocate(bytes, resource, charged));
+    return new(block) smart_data(new_capacity, reinterpret_cast<uint32_t *>(block + 1), resource, charged);
+}
+
+size_t smart_vector::smart_data::rounded_capacity(size_t capacity) {
+    return (block_size(capacity, source(capacity)) - sizeof(smart_data)) / sizeof(uint32_t);
+}
+
+smart_vector::smart_data *smart_vector::smart_data::create(smart_data const &other, size_t used, size_t new_capacity) {
+    smart_data *r = create(new_capacity);
+    std::memcpy(r->data, other.data, sizeof(uint32_t) * used);
+    return r;
 }
 
-smart_vector::smart_data::smart_data(const smart_vector::smart_data &other) :
-        capacity(other.capacity),
-        data(new uint32_t[other.capacity]) {
-    std::memcpy(data, other.data, sizeof(uint32_t) * capacity);
+smart_vector::smart_data *smart_vector::smart_data::create(uint32_t const *external, size_t size,
+                                                           void (*release)(void *), void *context) {
+    std::pmr::memory_resource *resource = current_resource;
+    unsigned charged;
+    void *block = allocate(block_size(0, resource), resource, charged);
+    smart_data *r = new(block) smart_data(size, const_cast<uint32_t *>(external), resource, charged);
+    r->release = release;
+    r->context = context;
+    return r;
 }
 
-smart_vector::smart_data::smart_data(const smart_vector::smart_data &other, size_t new_capacity) :
-        capacity(new_capacity),
-        data(new uint32_t[new_capacity]) {
-    size_t real_size = std::min(capacity, other.capacity);
-    std::memset(data + real_size, 0, sizeof(uint32_t) * (capacity - real_size));
-    std::memcpy(data, other.data, sizeof(uint32_t) * real_size);
+bool smart_vector::smart_data::is_unique() const {
+    return count_of_owners == 1 && release == nullptr;
 }
 
 smart_vector::smart_data *smart_vector::smart_data::hy() {
@@ -30,30 +112,60 @@ smart_vector::smart_data *smart_vector::smart_data::hy() {
 void smart_vector::smart_data::by() {
     --count_of_owners;
     if (count_of_owners == 0) {
-        delete this;
+        std::pmr::memory_resource *from = resource;
+        size_t bytes = block_size(release == nullptr ? capacity : 0, from);
+        memory_budget::release(bytes, charged);
+        this->~smart_data();
+        if (from == nullptr) {
+            limb_pool::deallocate(this, bytes);
+        } else {
+            from->deallocate(this, bytes, line_size);
+        }
     }
 }
 
 smart_vector::smart_data::~smart_data() {
-    delete[] data;
+    if (release != nullptr) {
+        release(context);
+    }
 }
 
 smart_vector::smart_vector() :
         length(0) {}
 
 smart_vector::smart_vector(size_t size) :
+        smart_vector(size, no_init) {
+    std::memset(data(), 0, sizeof(uint32_t) * size);
+}
+
+smart_vector::smart_vector(size_t size, no_init_t) :
         length(size) {
-    if (length > 1) {
-        big_object = new smart_data(size);
+    if (size > inline_capacity) {
+        big_object = smart_data::create(size);
+        heap = true;
+    }
+}
+
+smart_vector::smart_vector(uint32_t const *external, size_t size, void (*release)(void *), void *context) :
+        length(size) {
+    if (size > inline_capacity) {
+        big_object = smart_data::create(external, size, release, context);
+        heap = true;
+    } else {
+        if (length != 0) {
+            std::memcpy(little_object, external, sizeof(uint32_t) * length);
+        }
+        release(context);
     }
 }
 
 smart_vector::smart_vector(smart_vector const &other) noexcept :
-        length(other.length) {
-    if (length > 1) {
+        length(other.length),
+        heap(other.heap) {
+    if (is_big()) {
         big_object = other.big_object->hy();
     } else {
-        little_object = other.little_object;
+        std::memcpy(little_object, other.little_object, sizeof(little_object));
     }
 }
 
@@ -61,22 +173,23 @@ smart_vector &smart_vector::operator=(smart_vector const &other) noexcept {
     if (this == &other) {
         return *this;
     }
-    if (length > 1) {
+    if (is_big()) {
         big_object->by();
     }
 
     length = other.length;
+    heap = other.heap;
 
-    if (length > 1) {
+    if (is_big()) {
         big_object = other.big_object->hy();
     } else {
-        little_object = other.little_object;
+        std::memcpy(little_object, other.little_object, sizeof(little_object));
     }
     return *this;
 }
 
 smart_vector::~smart_vector() {
-    if (length > 1) {
+    if (is_big()) {
         big_object->by();
     }
 }
@@ -89,34 +202,39 @@ bool smart_vector::empty() const {
     return length == 0;
 }
 
+size_t smart_vector::capacity() const {
+    return is_big() ? big_object->capacity : inline_capacity;
+}
+
+void smart_vector::reserve(size_t size) {
+    if (size > capacity()) {
+        reallocate(length, size);
+    }
+}
+
+void smart_vector::shrink_to_fit() {
+    if (!is_big()) {
+        return;
+    }
+    if (length <= inline_capacity) {
+        to_little();
+    } else if (smart_data::rounded_capacity(length) < big_object->capacity) {
+        reallocate(length, length);
+    }
+}
+
 void smart_vector::resize(size_t size) {
-    switch (size) {
-        case 0:
-            if (length > 1) {
-                big_object->by();
-            }
-            little_object = 0;
-            break;
-        case 1:
-            if (length > 1) {
-                uint32_t v = big_object->data[0];
-                big_object->by();
-                little_object = v;
-            }
-            break;
-        default:
-            if (length > 0) {
-                if (big_object->count_of_owners != 1 || size > big_object->capacity || size < length) {
-                    smart_data *old = big_object;
-                    big_object = new smart_data(*big_object, size + 8);
-                    old->by();
-                }
-            } else {
-                uint32_t v = little_object;
-                big_object = new smart_data(size + 8);
-                big_object->data[0] = v;
-            }
-            break;
+    size_t old_length = length;
+    resize(size, no_init);
+    if (size > old_length) {
+        std::memset(data() + old_length, 0, sizeof(uint32_t) * (size - old_length));
+    }
+}
+
+// a shared block is left in place too, it is copied once written through data()
+void smart_vector::resize(size_t size, no_init_t) {
+    if (size > capacity()) {
+        reallocate(std::min(length, size), std::max(size, 2 * capacity()));
     }
     length = size;
 }
@@ -124,21 +242,21 @@ void smart_vector::resize(size_t size) {
 const uint32_t &smart_vector::operator[](int i) const {
     //assert(i >= 0);
     //assert(i < length);
-    if (length > 1) {
+    if (is_big()) {
         return big_object->data[i];
     } else {
-        return little_object;
+        return little_object[i];
     }
 }
 
 uint32_t &smart_vector::operator[](int i) {
     //assert(i >= 0);
     //assert(i < length);
-    if (length > 1) {
+    if (is_big()) {
         update();
         return big_object->data[i];
     } else {
-        return little_object;
+        return little_object[i];
     }
 }
 
@@ -152,49 +270,41 @@ uint32_t &smart_vector::back() {
     return (*this)[length - 1];
 }
 
+const uint32_t *smart_vector::data() const {
+    if (is_big()) {
+        return big_object->data;
+    } else {
+        return little_object;
+    }
+}
+
+uint32_t *smart_vector::data() {
+    if (is_big()) {
+        update();
+        return big_object->data;
+    } else {
+        return little_object;
+    }
+}
+
+limb_span smart_vector::span() {
+    return {data(), length};
+}
+
+const_limb_span smart_vector::span() const {
+    return {data(), length};
+}
+
 void smart_vector::push_back(uint32_t a) {
-    switch (length) {
-        case 0:
-            little_object = a;
-            break;
-        case 1: {
-            uint32_t v = little_object;
-            big_object = new smart_data(8);
-            big_object->data[0] = v;
-            big_object->data[1] = a;
-            break;
-        }
-        default:
-            if (length == big_object->capacity) {
-                smart_data *old = big_object;
-                big_object = new smart_data(*big_object, big_object->capacity * 2);
-                old->by();
-            } else {
-                update();
-            }
-            big_object->data[length] = a;
-            break;
+    if (length == capacity()) {
+        reallocate(length, 2 * length);
     }
+    data()[length] = a;
     ++length;
 }
 
 void smart_vector::pop_back() {
     //assert(length != 0);
-    switch (length) {
-        case 1:
-            little_object = 0;
-            break;
-        case 2: {
-            uint32_t v = big_object->data[0];
-            big_object->by();
-            little_object = v;
-            break;
-        }
-        default:
-            update();
-            big_object->data[length - 1] = 0;
-            break;
-    }
     --length;
 }
 
@@ -204,10 +314,33 @@ void smart_vector::swap(smart_vector &other) {
     other = tmp;
 }
 
+bool smart_vector::is_big() const {
+    return heap;
+}
+
+// moves the limbs of the heap block back inside, length must fit there
+void smart_vector::to_little() {
+    smart_data *old = big_object;
+    std::memcpy(little_object, old->data, sizeof(uint32_t) * length);
+    old->by();
+    heap = false;
+}
+
+// moves the first used limbs to a fresh heap block of at least new_capacity limbs
+void smart_vector::reallocate(size_t used, size_t new_capacity) {
+    smart_data *fresh = smart_data::create(new_capacity);
+    std::memcpy(fresh->data, is_big() ? big_object->data : little_object, sizeof(uint32_t) * used);
+    if (is_big()) {
+        big_object->by();
+    }
+    big_object = fresh;
+    heap = true;
+}
+
 inline void smart_vector::update() {
-    if (length > 1 && big_object->count_of_owners != 1) {
+    if (is_big() && !big_object->is_unique()) {
         smart_data *old = big_object;
-        big_object = new smart_data(*big_object);
+        big_object = smart_data::create(*old, length, old->capacity);
         old->by();
     }
-}
\ No newline at end of file
+}
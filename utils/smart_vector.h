@@ -5,14 +5,49 @@
 #ifndef SMART_VECTOR_H
 #define SMART_VECTOR_H
 
-#include <stdint-gcc.h>
-#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+
+// limbs kept inside the vector itself before it goes to the heap
+#ifndef SMART_VECTOR_INLINE_CAPACITY
+#define SMART_VECTOR_INLINE_CAPACITY 8
+#endif
+
+// tag for allocations whose limbs the caller overwrites anyway
+struct no_init_t {
+    explicit no_init_t() = default;
+};
+
+constexpr no_init_t no_init{};
+
+// raw limbs of a vector, valid until it is resized, reassigned or destroyed
+struct limb_span {
+    uint32_t *data;
+    size_t size;
+};
+
+struct const_limb_span {
+    uint32_t const *data;
+    size_t size;
+};
 
 struct smart_vector {
+    static const size_t inline_capacity = SMART_VECTOR_INLINE_CAPACITY;
+
+    static_assert(inline_capacity >= 1, "smart_vector needs at least one inline limb");
+
     smart_vector();
 
     explicit smart_vector(size_t size);
 
+    // the limbs are left uninitialised
+    smart_vector(size_t size, no_init_t);
+
+    // uses size limbs owned by someone else as read-only storage: any write copies them first,
+    // release(context) is called once the last sharing vector is gone
+    smart_vector(uint32_t const *external, size_t size, void (*release)(void *), void *context);
+
     smart_vector(smart_vector const &other) noexcept;
 
     smart_vector &operator=(smart_vector const &other) noexcept;
@@ -23,8 +58,20 @@ struct smart_vector {
 
     bool empty() const;
 
+    // limbs that fit without reallocating
+    size_t capacity() const;
+
+    void reserve(size_t size);
+
+    // gives back the unused limbs, moving them inside when they fit
+    void shrink_to_fit();
+
+    // grows geometrically, shrinks in place
     void resize(size_t size);
 
+    // limbs added past the old size are left uninitialised
+    void resize(size_t size, no_init_t);
+
     const uint32_t &operator[](int i) const;
 
     uint32_t &operator[](int i);
@@ -33,6 +80,16 @@ struct smart_vector {
 
     uint32_t &back();
 
+    const uint32_t *data() const;
+
+    // unshares the storage, so the pointer may be written through
+    uint32_t *data();
+
+    // unshares once, then the limbs are plain memory for tight loops
+    limb_span span();
+
+    const_limb_span span() const;
+
     void push_back(uint32_t a);
 
     void pop_back();
@@ -40,37 +97,93 @@ struct smart_vector {
     void swap(smart_vector &other);
 
 private:
+    static const size_t line_size = 64;
+
     size_t length;
 
-    struct smart_data {
+    // header and limbs live in one cache-aligned allocation: the limbs start right after
+    // the header, on the next line_size boundary. Borrowed blocks point data at external limbs
+    struct alignas(line_size) smart_data {
         const size_t capacity;
         uint32_t *data;
         uint64_t count_of_owners = 1;
+        void (*release)(void *) = nullptr;
+        void *context = nullptr;
+        // where the block came from, the limb pool if null
+        std::pmr::memory_resource *const resource;
+        // the memory budgets the block is counted against
+        const unsigned charged;
 
         smart_data() = delete;
 
+        smart_data(smart_data const &other) = delete;
+
         smart_data &operator=(smart_data const &other) = delete;
 
-        explicit smart_data(size_t new_capacity);
+        // limbs of new blocks are uninitialised
+        static smart_data *create(size_t new_capacity);
+
+        // copies the first used limbs of other
+        static smart_data *create(smart_data const &other, size_t used, size_t new_capacity);
+
+        static smart_data *create(uint32_t const *external, size_t size, void (*release)(void *), void *context);
 
-        smart_data(smart_data const &other);
+        // what create(capacity) would really give
+        static size_t rounded_capacity(size_t capacity);
 
-        smart_data(smart_data const &other, size_t new_capacity);
+        bool is_unique() const;
 
         smart_data *hy();
 
         void by();
 
     private:
+        smart_data(size_t capacity, uint32_t *data, std::pmr::memory_resource *resource, unsigned charged);
+
         ~smart_data();
+
+        static std::pmr::memory_resource *source(size_t capacity);
+
+        static size_t block_size(size_t capacity, std::pmr::memory_resource *resource);
+
+        static void *allocate(size_t bytes, std::pmr::memory_resource *resource, unsigned &charged);
     };
 
+    // limbs past length hold unspecified values
     union {
         smart_data *big_object;
-        uint32_t little_object = 0;
+        uint32_t little_object[inline_capacity] = {};
     };
 
+    // a heap block is kept once allocated, even if the limbs would fit inside again
+    bool heap = false;
+
+    bool is_big() const;
+
+    void to_little();
+
+    void reallocate(size_t used, size_t new_capacity);
+
     inline void update();
 };
 
+// while alive, limb blocks allocated by this thread come from resource, and so do the
+// scratch_frame temporaries of multiplication, division and conversion. Every block is given
+// back to the resource it came from, so values may outlive the scope but not the resource
+struct limb_resource_scope {
+    explicit limb_resource_scope(std::pmr::memory_resource *resource);
+
+    // the resource of the innermost scope of the calling thread, null outside any
+    static std::pmr::memory_resource *current();
+
+    limb_resource_scope(limb_resource_scope const &other) = delete;
+
+    limb_resource_scope &operator=(limb_resource_scope const &other) = delete;
+
+    ~limb_resource_scope();
+
+private:
+    std::pmr::memory_resource *previous;
+};
+
 #endif //SMART_VECTOR_H
\ No newline at end of file